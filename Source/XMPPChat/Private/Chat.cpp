@@ -6,9 +6,30 @@
 #include "ModuleManager.h"
 #include "Xmpp.h"
 #include "XmppConnection.h"
+#include "ChatEnvelope.h"
 
 DEFINE_LOG_CATEGORY(LogChat);
 
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Message RTT p50 (ms)"), STAT_ChatMessageRttP50, STATGROUP_XMPPChat);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Message RTT p95 (ms)"), STAT_ChatMessageRttP95, STATGROUP_XMPPChat);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Message RTT p99 (ms)"), STAT_ChatMessageRttP99, STATGROUP_XMPPChat);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Pending Receipts"), STAT_ChatPendingReceipts, STATGROUP_XMPPChat);
+DECLARE_MEMORY_STAT(TEXT("Chat Memory"), STAT_ChatMemory, STATGROUP_XMPPChat);
+
+static FAutoConsoleCommand ChatMemoryCommand(
+	TEXT("XmppChat.Memory"),
+	TEXT("Log the memory held by each chat"),
+	FConsoleCommandDelegate::CreateLambda([]()
+	{
+		for (TObjectIterator<UChat> It; It; ++It)
+		{
+			FChatMemoryStats Stats;
+			It->GetMemoryUsage(Stats);
+			UE_LOG(LogChat, Display, TEXT("%s: Total=%d Members=%d PubSubCache=%d PubSubQueue=%d RoomInfo=%d Receipts=%d Sequence=%d Unread=%d"),
+				*It->GetName(), Stats.TotalBytes, Stats.MemberBytes, Stats.PubSubCacheBytes, Stats.PubSubQueueBytes, Stats.RoomInfoBytes, Stats.ReceiptBytes, Stats.SequenceBytes, Stats.UnreadBytes);
+		}
+	}));
+
 UChatMember::UChatMember(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer),
 	Status(EUXmppPresenceStatus::Offline),
 	bIsAvailable(false),
@@ -29,9 +50,109 @@ void UChatMember::ConvertFrom(const FXmppChatMember& ChatMember)
 	Affiliation = UChatUtil::GetEUChatMemberRole(ChatMember.Affiliation);
 }
 
+SIZE_T UChatMember::GetAllocatedSize() const
+{
+	return sizeof(UChatMember) + Nickname.GetAllocatedSize() + MemberJid.GetAllocatedSize() + ClientResource.GetAllocatedSize() + StatusStr.GetAllocatedSize();
+}
+
+FChatRoomInfo::FChatRoomInfo() :
+	bIsPrivate(false),
+	bIsStale(true),
+	Age(0.0f)
+{
+}
+
+void FChatRoomInfo::ConvertFrom(const FXmppRoomInfo& RoomInfo)
+{
+	RoomId = RoomInfo.Id;
+	OwnerId = RoomInfo.OwnerId;
+	Subject = RoomInfo.Subject;
+	bIsPrivate = RoomInfo.bIsPrivate;
+}
+
+FChatPubSubStats::FChatPubSubStats() :
+	PublishRequests(0),
+	PublishesSent(0),
+	PublishesCoalesced(0),
+	KeyframesSent(0),
+	DeltasSent(0),
+	BytesRequested(0),
+	BytesSent(0),
+	ItemsReceived(0),
+	DeltasApplied(0),
+	DeltasDropped(0),
+	BytesReceived(0)
+{
+}
+
+static int32 SaturateToInt32(uint64 Value)
+{
+	return static_cast<int32>(FMath::Min<uint64>(Value, MAX_int32));
+}
+
+void FChatPubSubStats::ConvertFrom(const FChatPubSubCounters& Counters)
+{
+	PublishRequests = SaturateToInt32(Counters.PublishRequests);
+	PublishesSent = SaturateToInt32(Counters.PublishesSent);
+	PublishesCoalesced = SaturateToInt32(Counters.PublishesCoalesced);
+	KeyframesSent = SaturateToInt32(Counters.KeyframesSent);
+	DeltasSent = SaturateToInt32(Counters.DeltasSent);
+	BytesRequested = SaturateToInt32(Counters.BytesRequested);
+	BytesSent = SaturateToInt32(Counters.BytesSent);
+	ItemsReceived = SaturateToInt32(Counters.ItemsReceived);
+	DeltasApplied = SaturateToInt32(Counters.DeltasApplied);
+	DeltasDropped = SaturateToInt32(Counters.DeltasDropped);
+	BytesReceived = SaturateToInt32(Counters.BytesReceived);
+}
+
+FChatLatencyStats::FChatLatencyStats() :
+	P50(0.0f),
+	P95(0.0f),
+	P99(0.0f),
+	NumSamples(0),
+	NumPending(0),
+	NumTimedOut(0),
+	NumEvicted(0)
+{
+}
+
+FChatMemoryStats::FChatMemoryStats() :
+	MemberBytes(0),
+	PubSubCacheBytes(0),
+	PubSubQueueBytes(0),
+	RoomInfoBytes(0),
+	ReceiptBytes(0),
+	SequenceBytes(0),
+	UnreadBytes(0),
+	TotalBytes(0)
+{
+}
+
 /***************** Base **************************/
 
-UChat::UChat(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer), bInited(false), bDone(false)
+UChat::UChat(const FObjectInitializer& ObjectInitializer) : Super(ObjectInitializer), bInited(false), bDone(false),
+	ReportedMemory(0),
+	NextMemoryReportTime(0.0),
+	MaxUnreadMentions(256),
+	MaxUnreadPeers(256),
+	MaxPubSubCacheBytes(1024 * 1024),
+	MaxRoomInfoEntries(512),
+	MaxSequenceStreams(1024),
+	MaxReorderBufferBytes(256 * 1024),
+	MaxPubSubPublishNodes(256),
+	MaxPubSubDeltaStreams(1024),
+	bSequenceMessages(false),
+	ReorderTimeout(0.5f),
+	MaxReorderBuffer(16),
+	bDeliveryReceipts(false),
+	ReceiptTimeout(30.0f),
+	MaxPendingReceipts(256),
+	RoomInfoTTL(30.0f),
+	RoomInfoRequestTimeout(10.0f),
+	PubSubCacheSize(1),
+	PubSubBatchWindow(0.0f),
+	bPubSubDeltaEncoding(false),
+	PubSubKeyframeInterval(10)
 {
 }
 
@@ -72,6 +193,9 @@ void UChat::Init()
 			IXmppMultiUserChat::FOnXmppRoomChatReceived& OnXMPPMUCReceiveMessageDelegate = XmppConnection->MultiUserChat()->OnRoomChatReceived();
 			OnMUCReceiveMessageHandle = OnXMPPMUCReceiveMessageDelegate.AddUObject(this, &UChat::OnMUCReceiveMessageFunc);
 
+			IXmppMultiUserChat::FOnXmppRoomCreateComplete& OnXMPPMUCRoomCreateDelegate = XmppConnection->MultiUserChat()->OnRoomCreated();
+			OnMUCRoomCreateCompleteHandle = OnXMPPMUCRoomCreateDelegate.AddUObject(this, &UChat::OnMUCRoomCreateCompleteFunc);
+
 			IXmppMultiUserChat::FOnXmppRoomJoinPublicComplete& OnXMPPMUCRoomJoinPublicDelegate = XmppConnection->MultiUserChat()->OnJoinPublicRoom();
 			OnMUCRoomJoinPublicCompleteHandle = OnXMPPMUCRoomJoinPublicDelegate.AddUObject(this, &UChat::OnMUCRoomJoinPublicCompleteFunc);
 
@@ -86,7 +210,18 @@ void UChat::Init()
 
 			IXmppMultiUserChat::FOnXmppRoomMemberChanged& OnXMPPRoomMemberChangedDelegate = XmppConnection->MultiUserChat()->OnRoomMemberChanged();
 			OnMUCRoomMemberChangedHandle = OnXMPPRoomMemberChangedDelegate.AddUObject(this, &UChat::OnMUCRoomMemberChangedFunc);
+
+			IXmppMultiUserChat::FOnXmppRoomInfoRefreshed& OnXMPPRoomInfoRefreshedDelegate = XmppConnection->MultiUserChat()->OnRoomInfoRefreshed();
+			OnMUCRoomInfoRefreshedHandle = OnXMPPRoomInfoRefreshedDelegate.AddUObject(this, &UChat::OnMUCRoomInfoRefreshedFunc);
 		}
+
+		if (XmppConnection->PubSub().IsValid())
+		{
+			IXmppPubSub::FOnXmppPubSubMessageReceived& OnXMPPPubSubMessageReceivedDelegate = XmppConnection->PubSub()->OnMessageReceived();
+			OnPubSubMessageReceivedHandle = OnXMPPPubSubMessageReceivedDelegate.AddUObject(this, &UChat::OnPubSubMessageReceivedFunc);
+		}
+
+		TickHandle = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateUObject(this, &UChat::TickChat));
 	}
 }
 
@@ -102,11 +237,16 @@ void UChat::DeInit()
 		if (OnChatReceiveMessageHandle.IsValid()) { XmppConnection->Messages()->OnReceiveMessage().Remove(OnChatReceiveMessageHandle); }
 		if (OnPrivateChatReceiveMessageHandle.IsValid()) { XmppConnection->PrivateChat()->OnReceiveChat().Remove(OnPrivateChatReceiveMessageHandle); }
 		if (OnMUCReceiveMessageHandle.IsValid()) { XmppConnection->MultiUserChat()->OnRoomChatReceived().Remove(OnMUCReceiveMessageHandle); }
+		if (OnMUCRoomCreateCompleteHandle.IsValid()) { XmppConnection->MultiUserChat()->OnRoomCreated().Remove(OnMUCRoomCreateCompleteHandle); }
 		if (OnMUCRoomJoinPublicCompleteHandle.IsValid()) { XmppConnection->MultiUserChat()->OnJoinPublicRoom().Remove(OnMUCRoomJoinPublicCompleteHandle); }
 		if (OnMUCRoomJoinPrivateCompleteHandle.IsValid()) { XmppConnection->MultiUserChat()->OnJoinPrivateRoom().Remove(OnMUCRoomJoinPrivateCompleteHandle); }
 		if (OnMUCRoomMemberJoinHandle.IsValid()) { XmppConnection->MultiUserChat()->OnRoomMemberJoin().Remove(OnMUCRoomMemberJoinHandle); }
 		if (OnMUCRoomMemberExitHandle.IsValid()) { XmppConnection->MultiUserChat()->OnRoomMemberExit().Remove(OnMUCRoomMemberExitHandle); }
 		if (OnMUCRoomMemberChangedHandle.IsValid()) { XmppConnection->MultiUserChat()->OnRoomMemberChanged().Remove(OnMUCRoomMemberChangedHandle); }
+		if (OnMUCRoomInfoRefreshedHandle.IsValid()) { XmppConnection->MultiUserChat()->OnRoomInfoRefreshed().Remove(OnMUCRoomInfoRefreshedHandle); }
+		if (OnPubSubMessageReceivedHandle.IsValid()) { XmppConnection->PubSub()->OnMessageReceived().Remove(OnPubSubMessageReceivedHandle); }
+		if (TickHandle.IsValid()) { FTicker::GetCoreTicker().RemoveTicker(TickHandle); TickHandle.Reset(); }
+		ReportMemory(0);
 
 		FXmppModule::Get().RemoveConnection(XmppConnection.ToSharedRef());
 	}	
@@ -127,6 +267,147 @@ void UChat::Finish()
 	}
 }
 
+bool UChat::TickChat(float DeltaTime)
+{
+	const double Now = FPlatformTime::Seconds();
+
+	if (XmppConnection.IsValid() && XmppConnection->PubSub().IsValid())
+	{
+		PubSubPublisher.Flush(*XmppConnection->PubSub(), GetPubSubPublishSettings(), Now, false, PubSubCounters);
+	}
+
+	ReceiptTracker.Expire(Now, ReceiptTimeout);
+
+	TArray<FChatSequencedMessage> Ready;
+	Sequencer.Expire(Now, ReorderTimeout, Ready);
+	for (const FChatSequencedMessage& Message : Ready)
+	{
+		DeliverMessage(Message);
+	}
+
+	SET_FLOAT_STAT(STAT_ChatMessageRttP50, MessageLatency.GetPercentileMs(0.50f));
+	SET_FLOAT_STAT(STAT_ChatMessageRttP95, MessageLatency.GetPercentileMs(0.95f));
+	SET_FLOAT_STAT(STAT_ChatMessageRttP99, MessageLatency.GetPercentileMs(0.99f));
+	SET_DWORD_STAT(STAT_ChatPendingReceipts, ReceiptTracker.GetNumPending());
+
+	// one event for everything that changed this frame
+	TArray<FString> ChangedRooms;
+	TArray<FString> ChangedPeers;
+	RoomUnread.ConsumeChanged(ChangedRooms);
+	PeerUnread.ConsumeChanged(ChangedPeers);
+	if (ChangedRooms.Num() > 0 || ChangedPeers.Num() > 0)
+	{
+		OnChatUnreadChanged.Broadcast(ChangedRooms, ChangedPeers);
+	}
+
+	if (Now >= NextMemoryReportTime)
+	{
+		NextMemoryReportTime = Now + 1.0;
+
+		FChatMemoryStats MemoryStats;
+		GetMemoryUsage(MemoryStats);
+		ReportMemory(MemoryStats.TotalBytes);
+	}
+
+	return true;
+}
+
+void UChat::ReportMemory(int64 Bytes)
+{
+	DEC_MEMORY_STAT_BY(STAT_ChatMemory, ReportedMemory);
+	INC_MEMORY_STAT_BY(STAT_ChatMemory, Bytes);
+	ReportedMemory = Bytes;
+}
+
+/***************** Unread **************************/
+
+void UChat::SetMentionAliases(const TArray<FString>& Aliases)
+{
+	MentionMatcher.SetNames(Aliases);
+}
+
+void UChat::MucGetUnread(const FString& RoomId, int32& Unread, int32& Mentions, int32& LastIndex)
+{
+	RoomUnread.Get(RoomId, Unread, Mentions, LastIndex);
+}
+
+void UChat::MucMarkRead(const FString& RoomId, int32 UpToIndex)
+{
+	RoomUnread.MarkRead(RoomId, UpToIndex);
+}
+
+void UChat::PrivateChatGetUnread(const FString& UserId, int32& Unread, int32& Mentions, int32& LastIndex)
+{
+	PeerUnread.Get(UserId, Unread, Mentions, LastIndex);
+}
+
+void UChat::PrivateChatMarkRead(const FString& UserId, int32 UpToIndex)
+{
+	PeerUnread.MarkRead(UserId, UpToIndex);
+}
+
+void UChat::PrivateChatClearUnread(const FString& UserId)
+{
+	PeerUnread.Remove(UserId);
+}
+
+/***************** Memory **************************/
+
+void UChat::GetMemoryUsage(FChatMemoryStats& Stats)
+{
+	SIZE_T MemberBytes = 0;
+	if (XmppConnection.IsValid() && XmppConnection->MultiUserChat().IsValid())
+	{
+		TArray<FXmppRoomId> Rooms;
+		XmppConnection->MultiUserChat()->GetJoinedRooms(Rooms);
+		for (const FXmppRoomId& RoomId : Rooms)
+		{
+			TArray<FXmppChatMemberRef> RoomMembers;
+			XmppConnection->MultiUserChat()->GetMembers(RoomId, RoomMembers);
+			for (const FXmppChatMemberRef& Member : RoomMembers)
+			{
+				MemberBytes += sizeof(FXmppChatMember) + Member->Nickname.GetAllocatedSize() + Member->UserPresence.StatusStr.GetAllocatedSize()
+					+ Member->MemberJid.Id.GetAllocatedSize() + Member->MemberJid.Domain.GetAllocatedSize() + Member->MemberJid.Resource.GetAllocatedSize();
+			}
+		}
+	}
+
+	// members handed to BP by MucGetMembers, while they're alive
+	TArray<UObject*> ConvertedMembers;
+	GetObjectsWithOuter(this, ConvertedMembers, false);
+	for (UObject* Object : ConvertedMembers)
+	{
+		if (const UChatMember* Member = Cast<UChatMember>(Object))
+		{
+			MemberBytes += Member->GetAllocatedSize();
+		}
+	}
+
+	const SIZE_T PubSubCacheBytes = PubSubRegistry.GetAllocatedSize() + PubSubDecoder.GetAllocatedSize();
+	const SIZE_T PubSubQueueBytes = PubSubPublisher.GetAllocatedSize();
+	const SIZE_T RoomInfoBytes = RoomInfoCache.GetAllocatedSize();
+	const SIZE_T ReceiptBytes = ReceiptTracker.GetAllocatedSize();
+	const SIZE_T SequenceBytes = Sequencer.GetAllocatedSize();
+	SIZE_T UnreadBytes = RoomUnread.GetAllocatedSize() + PeerUnread.GetAllocatedSize() + RoomNicknames.GetAllocatedSize() + PendingRoomNicknames.GetAllocatedSize();
+	for (const auto& Nickname : RoomNicknames)
+	{
+		UnreadBytes += Nickname.Key.GetAllocatedSize() + Nickname.Value.GetAllocatedSize();
+	}
+	for (const auto& Nickname : PendingRoomNicknames)
+	{
+		UnreadBytes += Nickname.Key.GetAllocatedSize() + Nickname.Value.GetAllocatedSize();
+	}
+
+	Stats.MemberBytes = SaturateToInt32(MemberBytes);
+	Stats.PubSubCacheBytes = SaturateToInt32(PubSubCacheBytes);
+	Stats.PubSubQueueBytes = SaturateToInt32(PubSubQueueBytes);
+	Stats.RoomInfoBytes = SaturateToInt32(RoomInfoBytes);
+	Stats.ReceiptBytes = SaturateToInt32(ReceiptBytes);
+	Stats.SequenceBytes = SaturateToInt32(SequenceBytes);
+	Stats.UnreadBytes = SaturateToInt32(UnreadBytes);
+	Stats.TotalBytes = SaturateToInt32(MemberBytes + PubSubCacheBytes + PubSubQueueBytes + RoomInfoBytes + ReceiptBytes + SequenceBytes + UnreadBytes);
+}
+
 /***************** Login/Logout **************************/
 
 void UChat::Login(const FString& UserId, const FString& Auth, const FString& ServerAddr, const FString& Domain, const FString& ClientResource)
@@ -182,6 +463,9 @@ void UChat::OnLogingChangedFunc(const FXmppUserJid& UserJid, EXmppLoginStatus::T
 {
 	UE_LOG(LogChat, Log, TEXT("UChat::OnLogingChanged UserJid=%s LoginStatus=%d"), *UserJid.GetFullPath(), static_cast<int32>(LoginStatus));
 
+	// room state may have changed while we weren't connected, and answers in flight are lost
+	RoomInfoCache.InvalidateAll();
+
 	OnChatLogingChanged.Broadcast(UserJid.GetFullPath(), UChatUtil::GetEUXmppLoginStatus(LoginStatus));
 }
 
@@ -189,6 +473,9 @@ void UChat::Logout()
 {
 	if (XmppConnection.IsValid() && (XmppConnection->GetLoginStatus() == EXmppLoginStatus::LoggedIn))
 	{
+		// don't lose the latest state of batched nodes
+		PubSubFlush();
+
 		XmppConnection->Logout();
 	}
 }
@@ -199,14 +486,122 @@ void UChat::OnChatReceiveMessageFunc(const TSharedRef<IXmppConnection>& Connecti
 {
 	UE_LOG(LogChat, Log, TEXT("UChat::OnChatReceiveMessage UserJid=%s Type=%s Message=%s"), *FromJid.GetFullPath(), *Message->Type, *Message->Payload);
 
-	OnChatReceiveMessage.Broadcast(FromJid.GetFullPath(), Message->Type, Message->Payload);
+	FChatEnvelope Envelope;
+	FString Payload;
+	FChatEnvelope::Decode(Message->Payload, Envelope, Payload);
+
+	if (!Envelope.AckId.IsEmpty())
+	{
+		// receipts never carry a body and are not for BP; ones for another session of ours or an earlier chat just don't match
+		ReceiptTracker.Complete(Envelope.AckId, FPlatformTime::Seconds(), MessageLatency);
+		return;
+	}
+
+	if (!Envelope.ReceiptId.IsEmpty() && Connection->Messages().IsValid())
+	{
+		FChatEnvelope Ack;
+		Ack.AckId = Envelope.ReceiptId;
+
+		FXmppMessage AckMessage;
+		AckMessage.ToJid = FromJid;
+		AckMessage.Type = Message->Type;
+		AckMessage.Payload = Ack.Encode(FString());
+		Connection->Messages()->SendMessage(FromJid.Id, AckMessage);
+	}
+
+	OnChatReceiveMessage.Broadcast(FromJid.GetFullPath(), Message->Type, Payload);
 }
 
 void UChat::OnPrivateChatReceiveMessageFunc(const TSharedRef<IXmppConnection>& Connection, const FXmppUserJid& FromJid, const TSharedRef<FXmppChatMessage>& Message)
 {
 	UE_LOG(LogChat, Log, TEXT("UChat::OnPrivateChatReceiveMessage UserJid=%s Message=%s"), *FromJid.GetFullPath(), *Message->Body);
 
-	OnPrivateChatReceiveMessage.Broadcast(FromJid.GetFullPath(), Message->Body);
+	FChatEnvelope Envelope;
+	FString Body;
+	FChatEnvelope::Decode(Message->Body, Envelope, Body);
+
+	if (!Envelope.AckId.IsEmpty())
+	{
+		// receipts never carry a body and are not for BP; ones for another session of ours or an earlier chat just don't match
+		ReceiptTracker.Complete(Envelope.AckId, FPlatformTime::Seconds(), MessageLatency);
+		return;
+	}
+
+	if (!Envelope.ReceiptId.IsEmpty() && Connection->PrivateChat().IsValid())
+	{
+		FChatEnvelope Ack;
+		Ack.AckId = Envelope.ReceiptId;
+
+		FXmppChatMessage AckMessage;
+		AckMessage.ToJid = FromJid;
+		AckMessage.Body = Ack.Encode(FString());
+		Connection->PrivateChat()->SendChat(FromJid.Id, AckMessage);
+	}
+
+	FChatSequencedMessage Received;
+	Received.Channel = FromJid.Id;
+	Received.Sender = FromJid.GetFullPath();
+	Received.Body = MoveTemp(Body);
+	// one stream per resource, every session of the user numbers its messages on its own
+	ReceiveSequenced(TEXT("chat:") + Received.Sender, Envelope.SequenceSession, Envelope.Sequence, MoveTemp(Received));
+}
+
+FString UChat::EncodeOutgoingBody(const FString& Body, const FString& SequenceKey)
+{
+	FChatEnvelope Envelope;
+	if (bDeliveryReceipts)
+	{
+		Envelope.ReceiptId = ReceiptTracker.Track(FPlatformTime::Seconds(), MaxPendingReceipts);
+	}
+	if (bSequenceMessages && !SequenceKey.IsEmpty())
+	{
+		Envelope.SequenceSession = Sequencer.GetSessionId();
+		Envelope.Sequence = Sequencer.NextOutgoing(SequenceKey);
+	}
+	return Envelope.Encode(Body);
+}
+
+void UChat::ReceiveSequenced(const FString& StreamKey, const FString& Session, uint32 Sequence, FChatSequencedMessage&& Message)
+{
+	if (Session.IsEmpty())
+	{
+		// sender doesn't sequence its messages
+		DeliverMessage(Message);
+		return;
+	}
+
+	TArray<FChatSequencedMessage> Ready;
+	Sequencer.Receive(StreamKey, Session, Sequence, MoveTemp(Message), FPlatformTime::Seconds(), MaxReorderBuffer, MaxReorderBufferBytes, MaxSequenceStreams, Ready);
+	for (const FChatSequencedMessage& ReadyMessage : Ready)
+	{
+		DeliverMessage(ReadyMessage);
+	}
+}
+
+void UChat::DeliverMessage(const FChatSequencedMessage& Message)
+{
+	// count before broadcasting, so BP handlers see the index of this message
+	if (Message.bIsRoom)
+	{
+		const FString* Nickname = RoomNicknames.Find(Message.Channel);
+		if (Nickname == nullptr || *Nickname != Message.Sender)
+		{
+			RoomUnread.Add(Message.Channel, MentionMatcher.Matches(Message.Body, Nickname != nullptr ? *Nickname : FString()), MaxUnreadMentions, 0);
+		}
+		OnMUCReceiveMessage.Broadcast(Message.Channel, Message.Sender, Message.Body);
+	}
+	else
+	{
+		PeerUnread.Add(Message.Channel, MentionMatcher.Matches(Message.Body, FString()), MaxUnreadMentions, MaxUnreadPeers);
+		OnPrivateChatReceiveMessage.Broadcast(Message.Sender, Message.Body);
+	}
+}
+
+void UChat::GetMessageSequenceStats(int32& Duplicates, int32& Reordered, int32& Skipped)
+{
+	Duplicates = SaturateToInt32(Sequencer.GetNumDuplicates());
+	Reordered = SaturateToInt32(Sequencer.GetNumReordered());
+	Skipped = SaturateToInt32(Sequencer.GetNumSkipped());
 }
 
 void UChat::Message(const FString& UserName, const FString& Recipient, const FString& Type, const FString& MessagePayload)
@@ -217,7 +612,7 @@ void UChat::Message(const FString& UserName, const FString& Recipient, const FSt
 		Message.FromJid.Id = UserName;
 		Message.ToJid.Id = Recipient;
 		Message.Type = Type;
-		Message.Payload = MessagePayload;
+		Message.Payload = EncodeOutgoingBody(MessagePayload, FString());
 		XmppConnection->Messages()->SendMessage(Recipient, Message);
 	}
 }
@@ -229,11 +624,27 @@ void UChat::PrivateChat(const FString& UserName, const FString& Recipient, const
 		FXmppChatMessage ChatMessage;
 		ChatMessage.FromJid.Id = UserName;
 		ChatMessage.ToJid.Id = Recipient;
-		ChatMessage.Body = Body;
+		ChatMessage.Body = EncodeOutgoingBody(Body, TEXT("chat:") + Recipient);
 		XmppConnection->PrivateChat()->SendChat(Recipient, ChatMessage);
 	}
 }
 
+void UChat::GetMessageLatency(FChatLatencyStats& Stats)
+{
+	Stats.P50 = MessageLatency.GetPercentileMs(0.50f);
+	Stats.P95 = MessageLatency.GetPercentileMs(0.95f);
+	Stats.P99 = MessageLatency.GetPercentileMs(0.99f);
+	Stats.NumSamples = MessageLatency.GetNumSamples();
+	Stats.NumPending = ReceiptTracker.GetNumPending();
+	Stats.NumTimedOut = SaturateToInt32(ReceiptTracker.GetNumTimedOut());
+	Stats.NumEvicted = SaturateToInt32(ReceiptTracker.GetNumEvicted());
+}
+
+void UChat::ResetMessageLatency()
+{
+	MessageLatency.Reset();
+}
+
 
 /***************** Presence **************************/
 
@@ -284,38 +695,86 @@ void UChat::OnMUCReceiveMessageFunc(const TSharedRef<IXmppConnection>& Connectio
 {
 	if (Connection->MultiUserChat().IsValid())
 	{
-		OnMUCReceiveMessage.Broadcast(static_cast<FString>(RoomId), UserJid.Resource, *ChatMsg->Body);
+		FChatEnvelope Envelope;
+		FString Body;
+		FChatEnvelope::Decode(ChatMsg->Body, Envelope, Body);
+
+		if (!Envelope.ReceiptId.IsEmpty())
+		{
+			// the room echoes our own messages back, that is the receipt; ids of other senders won't match
+			ReceiptTracker.Complete(Envelope.ReceiptId, FPlatformTime::Seconds(), MessageLatency);
+		}
+
+		FChatSequencedMessage Received;
+		Received.bIsRoom = true;
+		Received.Channel = static_cast<FString>(RoomId);
+		Received.Sender = UserJid.Resource;
+		Received.Body = MoveTemp(Body);
+		ReceiveSequenced(TEXT("muc:") + Received.Channel + TEXT("/") + Received.Sender, Envelope.SequenceSession, Envelope.Sequence, MoveTemp(Received));
 	}
 }
 
+void UChat::OnMUCRoomCreateCompleteFunc(const TSharedRef<IXmppConnection>& Connection, bool bSuccess, const FXmppRoomId& RoomId, const FString& Error)
+{
+	UE_LOG(LogChat, Log, TEXT("UChat::OnMUCRoomCreateComplete RoomId=%s Success=%s Error=%s"), *static_cast<FString>(RoomId), bSuccess ? TEXT("true") : TEXT("false"), *Error);
+
+	// creating a room also joins it
+	CompleteRoomJoin(bSuccess, RoomId);
+}
+
 void UChat::OnMUCRoomJoinPublicCompleteFunc(const TSharedRef<IXmppConnection>& Connection, bool bSuccess, const FXmppRoomId& RoomId, const FString& Error)
 {
+	CompleteRoomJoin(bSuccess, RoomId);
 	OnMUCRoomJoinPublicComplete.Broadcast(bSuccess, static_cast<FString>(RoomId), Error);
 }
 
 void UChat::OnMUCRoomJoinPrivateCompleteFunc(const TSharedRef<IXmppConnection>& Connection, bool bSuccess, const FXmppRoomId& RoomId, const FString& Error)
 {
+	CompleteRoomJoin(bSuccess, RoomId);
 	OnMUCRoomJoinPrivateComplete.Broadcast(bSuccess, static_cast<FString>(RoomId), Error);
 }
 
+void UChat::CompleteRoomJoin(bool bSuccess, const FString& RoomId)
+{
+	FString Nickname;
+	if (PendingRoomNicknames.RemoveAndCopyValue(RoomId, Nickname) && bSuccess)
+	{
+		RoomNicknames.Add(RoomId, Nickname);
+	}
+}
+
 void UChat::OnMUCRoomMemberJoinFunc(const TSharedRef<IXmppConnection>& Connection, const FXmppRoomId& RoomId, const FXmppUserJid& UserJid)
 {	
 	UE_LOG(LogChat, Log, TEXT("UChat::OnMUCRoomMemberJoin RoomId=%s UserJid=%s"), *static_cast<FString>(RoomId), *UserJid.GetFullPath());
+	RoomInfoCache.Invalidate(RoomId);
 	OnMUCRoomMemberJoin.Broadcast(static_cast<FString>(RoomId), UserJid.Resource);
 }
 
 void UChat::OnMUCRoomMemberExitFunc(const TSharedRef<IXmppConnection>& Connection, const FXmppRoomId& RoomId, const FXmppUserJid& UserJid)
 {
 	UE_LOG(LogChat, Log, TEXT("UChat::OnMUCRoomMemberExit RoomId=%s UserJid=%s"), *static_cast<FString>(RoomId), *UserJid.GetFullPath());
+	RoomInfoCache.Invalidate(RoomId);
 	OnMUCRoomMemberExit.Broadcast(static_cast<FString>(RoomId), UserJid.Resource);
 }
 
 void UChat::OnMUCRoomMemberChangedFunc(const TSharedRef<IXmppConnection>& Connection, const FXmppRoomId& RoomId, const FXmppUserJid& UserJid)
 {
 	UE_LOG(LogChat, Log, TEXT("UChat::OnMUCRoomMemberChanged RoomId=%s UserJid=%s"), *static_cast<FString>(RoomId), *UserJid.GetFullPath());
+	RoomInfoCache.Invalidate(RoomId);
 	OnMUCRoomMemberChanged.Broadcast(static_cast<FString>(RoomId), UserJid.Resource);
 }
 
+void UChat::OnMUCRoomInfoRefreshedFunc(const TSharedRef<IXmppConnection>& Connection, bool bSuccess, const FXmppRoomId& RoomId, const FString& Error)
+{
+	UE_LOG(LogChat, Log, TEXT("UChat::OnMUCRoomInfoRefreshed RoomId=%s Success=%s Error=%s"), *static_cast<FString>(RoomId), bSuccess ? TEXT("true") : TEXT("false"), *Error);
+
+	FXmppRoomInfo RoomInfo;
+	bool bHaveInfo = bSuccess && Connection->MultiUserChat().IsValid() && Connection->MultiUserChat()->GetRoomInfo(RoomId, RoomInfo);
+	RoomInfoCache.CompleteRefresh(RoomId, bHaveInfo, RoomInfo, FPlatformTime::Seconds(), MaxRoomInfoEntries);
+
+	OnMUCRoomInfoRefreshed.Broadcast(bSuccess, static_cast<FString>(RoomId), Error);
+}
+
 void UChat::MucCreate(const FString& UserName, const FString& RoomId, bool bIsPrivate, const FString& Password)
 {
 	if (XmppConnection.IsValid() && XmppConnection->MultiUserChat().IsValid())
@@ -325,6 +784,7 @@ void UChat::MucCreate(const FString& UserName, const FString& RoomId, bool bIsPr
 		RoomConfig.bIsPersistent = false;
 		RoomConfig.bIsPrivate = bIsPrivate;		
 		RoomConfig.Password = Password;
+		PendingRoomNicknames.Add(RoomId, UserName);
 		XmppConnection->MultiUserChat()->CreateRoom(RoomId, UserName, RoomConfig);
 	}
 }
@@ -333,6 +793,8 @@ void UChat::MucJoin(const FString& RoomId, const FString& Nickname, const FStrin
 {
 	if (XmppConnection.IsValid() && XmppConnection->MultiUserChat().IsValid())
 	{
+		PendingRoomNicknames.Add(RoomId, Nickname);
+
 		if (Password.IsEmpty())
 		{
 			XmppConnection->MultiUserChat()->JoinPublicRoom(RoomId, Nickname);
@@ -350,13 +812,17 @@ void UChat::MucExit(const FString& RoomId)
 	{
 		XmppConnection->MultiUserChat()->ExitRoom(RoomId);
 	}
+	RoomInfoCache.Invalidate(RoomId);
+	RoomNicknames.Remove(RoomId);
+	PendingRoomNicknames.Remove(RoomId);
+	RoomUnread.Remove(RoomId);
 }
 
 void UChat::MucChat(const FString& RoomId, const FString& Body)
 {				
 	if (XmppConnection.IsValid() && XmppConnection->MultiUserChat().IsValid())
 	{
-		XmppConnection->MultiUserChat()->SendChat(RoomId, Body);
+		XmppConnection->MultiUserChat()->SendChat(RoomId, EncodeOutgoingBody(Body, TEXT("muc:") + RoomId));
 	}
 }
 
@@ -369,14 +835,40 @@ void UChat::MucConfig(const FString& UserName, const FString& RoomId, bool bIsPr
 		RoomConfig.Password = Password;
 		XmppConnection->MultiUserChat()->ConfigureRoom(RoomId, RoomConfig);
 	}
+	RoomInfoCache.Invalidate(RoomId);
 }
 
-void UChat::MucRefresh(const FString& RoomId)
+void UChat::MucRefresh(const FString& RoomId, bool bForce)
 {
 	if (XmppConnection.IsValid() && XmppConnection->MultiUserChat().IsValid())
 	{
-		XmppConnection->MultiUserChat()->RefreshRoomInfo(RoomId);
+		const double Now = FPlatformTime::Seconds();
+		if (RoomInfoCache.BeginRefresh(RoomId, Now, RoomInfoTTL, RoomInfoRequestTimeout, bForce, MaxRoomInfoEntries))
+		{
+			if (!XmppConnection->MultiUserChat()->RefreshRoomInfo(RoomId))
+			{
+				// nothing went out, don't make the next refresh wait for it
+				RoomInfoCache.CompleteRefresh(RoomId, false, FXmppRoomInfo(), Now, MaxRoomInfoEntries);
+			}
+		}
+	}
+}
+
+bool UChat::MucGetCachedRoomInfo(const FString& RoomId, FChatRoomInfo& RoomInfo)
+{
+	bool bIsStale = true;
+	float Age = 0.0f;
+	const FXmppRoomInfo* CachedInfo = RoomInfoCache.Find(RoomId, FPlatformTime::Seconds(), RoomInfoTTL, bIsStale, Age);
+	if (CachedInfo == nullptr)
+	{
+		return false;
 	}
+
+	RoomInfo.ConvertFrom(*CachedInfo);
+	RoomInfo.RoomId = RoomId;
+	RoomInfo.bIsStale = bIsStale;
+	RoomInfo.Age = Age;
+	return true;
 }
 
 void UChat::MucGetMembers(const FString& RoomId, TArray<UChatMember*>& Members)
@@ -390,7 +882,7 @@ void UChat::MucGetMembers(const FString& RoomId, TArray<UChatMember*>& Members)
 		Members.Reserve(OutMembers.Num());
 		for (auto& Member : OutMembers)
 		{
-			UChatMember* UMember = NewObject<UChatMember>();
+			UChatMember* UMember = NewObject<UChatMember>(this);
 			UMember->ConvertFrom(Member.Get());
 			Members.Add(UMember);
 		}
@@ -399,6 +891,22 @@ void UChat::MucGetMembers(const FString& RoomId, TArray<UChatMember*>& Members)
 
 /***************** PubSub **************************/
 
+void UChat::OnPubSubMessageReceivedFunc(const TSharedRef<IXmppConnection>& Connection, const FXmppPubSubId& NodeId, const TSharedRef<FXmppPubSubMessage>& Message)
+{
+	UE_LOG(LogChat, Log, TEXT("UChat::OnPubSubMessageReceived NodeId=%s FromJid=%s"), *NodeId, *Message->FromJid.GetFullPath());
+
+	TSharedPtr<const FXmppPubSubMessage> Item = PubSubDecoder.Decode(NodeId, Message, MaxPubSubDeltaStreams, PubSubCounters);
+	if (!Item.IsValid())
+	{
+		UE_LOG(LogChat, Log, TEXT("UChat::OnPubSubMessageReceived NodeId=%s dropped delta, waiting for keyframe"), *NodeId);
+		return;
+	}
+
+	PubSubRegistry.Dispatch(NodeId, Item.ToSharedRef(), PubSubCacheSize, MaxPubSubCacheBytes);
+
+	OnPubSubReceiveMessage.Broadcast(NodeId, Item->FromJid.GetFullPath(), Item->Payload);
+}
+
 void UChat::PubSubCreate(const FString& NodeId)
 {
 	if (XmppConnection.IsValid() && XmppConnection->PubSub().IsValid())
@@ -414,6 +922,9 @@ void UChat::PubSubDestroy(const FString& NodeId)
 	{
 		XmppConnection->PubSub()->DestroyNode(NodeId);
 	}
+	PubSubRegistry.RemoveNode(NodeId);
+	PubSubPublisher.RemoveNode(NodeId);
+	PubSubDecoder.RemoveNode(NodeId);
 }
 
 void UChat::PubSubSubscribe(const FString& NodeId)
@@ -430,17 +941,59 @@ void UChat::PubSubUnsubscribe(const FString& NodeId)
 	{
 		XmppConnection->PubSub()->Unsubscribe(NodeId);
 	}
+	PubSubRegistry.ClearCache(NodeId);
+	PubSubDecoder.RemoveNode(NodeId);
 }
 
 void UChat::PubSubPublish(const FString& NodeId, const FString& Payload)
 {
 	if (XmppConnection.IsValid() && XmppConnection->PubSub().IsValid())
 	{
-		FXmppPubSubMessage Message;
-		Message.Payload = Payload;
-		XmppConnection->PubSub()->PublishMessage(NodeId, Message);
+		PubSubPublisher.Publish(*XmppConnection->PubSub(), NodeId, Payload, GetPubSubPublishSettings(), FPlatformTime::Seconds(), PubSubCounters);
 	}
 }
 
+void UChat::PubSubFlush()
+{
+	if (XmppConnection.IsValid() && XmppConnection->PubSub().IsValid())
+	{
+		PubSubPublisher.Flush(*XmppConnection->PubSub(), GetPubSubPublishSettings(), FPlatformTime::Seconds(), true, PubSubCounters);
+	}
+}
 
+FChatPubSubPublishSettings UChat::GetPubSubPublishSettings() const
+{
+	FChatPubSubPublishSettings Settings;
+	Settings.BatchWindow = PubSubBatchWindow;
+	Settings.bDeltaEncoding = bPubSubDeltaEncoding;
+	Settings.KeyframeInterval = PubSubKeyframeInterval;
+	Settings.MaxNodes = MaxPubSubPublishNodes;
+	return Settings;
+}
 
+void UChat::PubSubGetStats(FChatPubSubStats& Stats)
+{
+	Stats.ConvertFrom(PubSubCounters);
+}
+
+void UChat::PubSubGetCachedItems(const FString& NodeId, TArray<FString>& Payloads)
+{
+	TArray<FChatPubSubItemRef> Items;
+	PubSubRegistry.GetCachedItems(NodeId, Items);
+
+	Payloads.Empty(Items.Num());
+	for (const FChatPubSubItemRef& Item : Items)
+	{
+		Payloads.Add(Item->Payload);
+	}
+}
+
+FDelegateHandle UChat::PubSubAddListener(const FString& NodeId, const FOnChatPubSubItem::FDelegate& Listener, bool bReplayCached)
+{
+	return PubSubRegistry.AddListener(NodeId, Listener, bReplayCached);
+}
+
+void UChat::PubSubRemoveListener(const FString& NodeId, FDelegateHandle Handle)
+{
+	PubSubRegistry.RemoveListener(NodeId, Handle);
+}
@@ -0,0 +1,95 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#include "XMPPChatPrivatePCH.h"
+#include "ChatEnvelope.h"
+
+namespace ChatEnvelopeWire
+{
+	static const TCHAR* Marker = TEXT("~xc|");
+	static const int32 MarkerLen = 4;
+
+	static void AppendField(FString& Fields, const TCHAR* Key, const FString& Value)
+	{
+		if (!Value.IsEmpty())
+		{
+			if (!Fields.IsEmpty())
+			{
+				Fields += TEXT(";");
+			}
+			Fields += Key;
+			Fields += TEXT("=");
+			Fields += Value;
+		}
+	}
+}
+
+bool FChatEnvelope::IsEmpty() const
+{
+	return ReceiptId.IsEmpty() && AckId.IsEmpty() && SequenceSession.IsEmpty();
+}
+
+FString FChatEnvelope::Encode(const FString& Body) const
+{
+	if (IsEmpty())
+	{
+		// a body that looks like an envelope gets an empty one, so Decode hands it back whole
+		return Body.StartsWith(ChatEnvelopeWire::Marker, ESearchCase::CaseSensitive)
+			? FString(ChatEnvelopeWire::Marker) + TEXT("|") + Body
+			: Body;
+	}
+
+	FString Fields;
+	ChatEnvelopeWire::AppendField(Fields, TEXT("r"), ReceiptId);
+	ChatEnvelopeWire::AppendField(Fields, TEXT("a"), AckId);
+	if (!SequenceSession.IsEmpty())
+	{
+		ChatEnvelopeWire::AppendField(Fields, TEXT("e"), SequenceSession);
+		ChatEnvelopeWire::AppendField(Fields, TEXT("s"), FString::Printf(TEXT("%u"), Sequence));
+	}
+
+	return FString(ChatEnvelopeWire::Marker) + Fields + TEXT("|") + Body;
+}
+
+bool FChatEnvelope::Decode(const FString& Wire, FChatEnvelope& OutEnvelope, FString& OutBody)
+{
+	OutEnvelope = FChatEnvelope();
+
+	const int32 FieldsEnd = Wire.StartsWith(ChatEnvelopeWire::Marker, ESearchCase::CaseSensitive)
+		? Wire.Find(TEXT("|"), ESearchCase::CaseSensitive, ESearchDir::FromStart, ChatEnvelopeWire::MarkerLen)
+		: INDEX_NONE;
+	if (FieldsEnd == INDEX_NONE)
+	{
+		OutBody = Wire;
+		return false;
+	}
+
+	TArray<FString> Fields;
+	Wire.Mid(ChatEnvelopeWire::MarkerLen, FieldsEnd - ChatEnvelopeWire::MarkerLen).ParseIntoArray(Fields, TEXT(";"), true);
+	for (const FString& Field : Fields)
+	{
+		FString Key;
+		FString Value;
+		if (Field.Split(TEXT("="), &Key, &Value))
+		{
+			if (Key == TEXT("r"))
+			{
+				OutEnvelope.ReceiptId = Value;
+			}
+			else if (Key == TEXT("a"))
+			{
+				OutEnvelope.AckId = Value;
+			}
+			else if (Key == TEXT("e"))
+			{
+				OutEnvelope.SequenceSession = Value;
+			}
+			else if (Key == TEXT("s"))
+			{
+				OutEnvelope.Sequence = static_cast<uint32>(FCString::Strtoui64(*Value, nullptr, 10));
+			}
+		}
+	}
+
+	OutBody = Wire.Mid(FieldsEnd + 1);
+	return true;
+}
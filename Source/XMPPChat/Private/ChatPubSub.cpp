@@ -0,0 +1,633 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#include "XMPPChatPrivatePCH.h"
+#include "ChatPubSub.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("PubSub Publish Requests"), STAT_ChatPubSubPublishRequests, STATGROUP_XMPPChat);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("PubSub Publishes Sent"), STAT_ChatPubSubPublishesSent, STATGROUP_XMPPChat);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("PubSub Bytes Sent"), STAT_ChatPubSubBytesSent, STATGROUP_XMPPChat);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("PubSub Items Received"), STAT_ChatPubSubItemsReceived, STATGROUP_XMPPChat);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("PubSub Bytes Received"), STAT_ChatPubSubBytesReceived, STATGROUP_XMPPChat);
+
+namespace ChatPubSubWire
+{
+	// Encoded items look like
+	//   ~xd|K|<seq>|<payload>
+	//   ~xd|D|<seq>|<prefix len>|<suffix len>|<middle>
+	//   ~xd|R|<payload>
+	// where a delta rebuilds item <seq> from item <seq - 1> as prefix + middle + suffix,
+	// and R escapes a raw payload that itself starts with the marker.
+	// Prefix and suffix lengths count UTF-8 bytes and always end on a code point, since
+	// TCHAR is UTF-16 on some platforms and UTF-32 on others
+	static const TCHAR* Marker = TEXT("~xd|");
+	static const int32 MarkerLen = 4;
+
+	static int32 Utf8Len(const FString& Str)
+	{
+		return FTCHARToUTF8(*Str).Length();
+	}
+
+	static void ToUtf8(const FString& Str, TArray<ANSICHAR>& Out)
+	{
+		FTCHARToUTF8 Converted(*Str);
+		Out.Reset(Converted.Length());
+		Out.Append(Converted.Get(), Converted.Length());
+	}
+
+	static FString FromUtf8(const ANSICHAR* Data, int32 Len)
+	{
+		if (Len <= 0)
+		{
+			return FString();
+		}
+		FUTF8ToTCHAR Converted(Data, Len);
+		return FString(Converted.Length(), Converted.Get());
+	}
+
+	// byte after the first of a multi byte code point
+	static bool IsContinuation(ANSICHAR Char)
+	{
+		return (static_cast<uint8>(Char) & 0xC0) == 0x80;
+	}
+
+	static FString EncodeKeyframe(uint32 Sequence, const FString& Payload)
+	{
+		return FString::Printf(TEXT("%sK|%u|"), Marker, Sequence) + Payload;
+	}
+
+	static FString EncodeDelta(uint32 Sequence, const FString& PrevStr, const FString& NextStr)
+	{
+		TArray<ANSICHAR> Prev;
+		TArray<ANSICHAR> Next;
+		ToUtf8(PrevStr, Prev);
+		ToUtf8(NextStr, Next);
+		const int32 MaxCommon = FMath::Min(Prev.Num(), Next.Num());
+
+		int32 Prefix = 0;
+		while (Prefix < MaxCommon && Prev[Prefix] == Next[Prefix])
+		{
+			++Prefix;
+		}
+		// don't end the prefix inside a code point
+		while (Prefix > 0 && ((Prefix < Next.Num() && IsContinuation(Next[Prefix])) || (Prefix < Prev.Num() && IsContinuation(Prev[Prefix]))))
+		{
+			--Prefix;
+		}
+
+		int32 Suffix = 0;
+		while (Suffix < MaxCommon - Prefix && Prev[Prev.Num() - 1 - Suffix] == Next[Next.Num() - 1 - Suffix])
+		{
+			++Suffix;
+		}
+		// nor start the suffix inside one
+		while (Suffix > 0 && IsContinuation(Next[Next.Num() - Suffix]))
+		{
+			--Suffix;
+		}
+
+		return FString::Printf(TEXT("%sD|%u|%d|%d|"), Marker, Sequence, Prefix, Suffix) + FromUtf8(Next.GetData() + Prefix, Next.Num() - Prefix - Suffix);
+	}
+
+	// read decimal digits up to the next '|' and step past it
+	static bool ParseField(const FString& Wire, int32& Pos, uint32& Out)
+	{
+		uint32 Value = 0;
+		const int32 Start = Pos;
+		while (Pos < Wire.Len() && FChar::IsDigit(Wire[Pos]))
+		{
+			Value = Value * 10 + (Wire[Pos] - TEXT('0'));
+			++Pos;
+		}
+		if (Pos == Start || Pos >= Wire.Len() || Wire[Pos] != TEXT('|'))
+		{
+			return false;
+		}
+		++Pos;
+		Out = Value;
+		return true;
+	}
+}
+
+/***************** Registry **************************/
+
+void FChatPubSubRegistry::FNode::Linearize()
+{
+	if (Head != 0)
+	{
+		TArray<FCachedItem> Ordered;
+		Ordered.Reserve(Items.Num());
+		for (int32 Idx = 0; Idx < Items.Num(); ++Idx)
+		{
+			Ordered.Add(Items[(Head + Idx) % Items.Num()]);
+		}
+		Items = MoveTemp(Ordered);
+		Head = 0;
+	}
+}
+
+TSharedRef<FChatPubSubRegistry::FNode> FChatPubSubRegistry::FindOrAddNode(const FXmppPubSubId& NodeId)
+{
+	if (TSharedRef<FNode>* Found = Nodes.Find(NodeId))
+	{
+		return *Found;
+	}
+	TSharedRef<FNode> Node = MakeShareable(new FNode());
+	Node->NodeId = NodeId;
+	return Nodes.Add(NodeId, Node);
+}
+
+FDelegateHandle FChatPubSubRegistry::AddListener(const FXmppPubSubId& NodeId, const FOnChatPubSubItem::FDelegate& Listener, bool bReplayCached)
+{
+	TSharedRef<FNode> Node = FindOrAddNode(NodeId);
+
+	if (bReplayCached)
+	{
+		Node->Linearize();
+		for (const FCachedItem& Cached : Node->Items)
+		{
+			Listener.ExecuteIfBound(NodeId, Cached.Item);
+		}
+	}
+
+	return Node->Listeners.Add(Listener);
+}
+
+void FChatPubSubRegistry::RemoveListener(const FXmppPubSubId& NodeId, FDelegateHandle Handle)
+{
+	if (TSharedRef<FNode>* Node = Nodes.Find(NodeId))
+	{
+		(*Node)->Listeners.Remove(Handle);
+		PruneNode(NodeId);
+	}
+}
+
+void FChatPubSubRegistry::Dispatch(const FXmppPubSubId& NodeId, const FChatPubSubItemRef& Item, int32 CacheSize, int32 MaxCacheBytes)
+{
+	TSharedRef<FNode> Node = FindOrAddNode(NodeId);
+
+	if (CacheSize <= 0)
+	{
+		RemoveOldest(*Node, Node->Items.Num());
+	}
+	else
+	{
+		if (Node->Items.Num() > CacheSize)
+		{
+			// cache size was lowered
+			RemoveOldest(*Node, Node->Items.Num() - CacheSize);
+		}
+
+		const FCachedItem Cached(Item, NextStamp++, GetItemSize(*Item));
+		CachedBytes += Cached.Bytes;
+		PushAge(Node, Cached.Stamp);
+
+		if (Node->Items.Num() < CacheSize)
+		{
+			Node->Linearize();
+			Node->Items.Add(Cached);
+			NumCachedItems++;
+		}
+		else
+		{
+			CachedBytes -= Node->Items[Node->Head].Bytes;
+			Node->Items[Node->Head] = Cached;
+			Node->Head = (Node->Head + 1) % Node->Items.Num();
+		}
+
+		while (MaxCacheBytes > 0 && CachedBytes > static_cast<SIZE_T>(MaxCacheBytes))
+		{
+			EvictOldest();
+		}
+	}
+
+	Node->Listeners.Broadcast(NodeId, Item);
+
+	// nodes nobody listens to and with nothing cached aren't kept around
+	PruneNode(NodeId);
+}
+
+void FChatPubSubRegistry::RemoveOldest(FNode& Node, int32 Count)
+{
+	if (Count > 0)
+	{
+		Node.Linearize();
+		for (int32 Idx = 0; Idx < Count; ++Idx)
+		{
+			CachedBytes -= Node.Items[Idx].Bytes;
+		}
+		Node.Items.RemoveAt(0, Count);
+		NumCachedItems -= Count;
+	}
+}
+
+bool FChatPubSubRegistry::IsCached(const FAgeEntry& Entry)
+{
+	// items only ever leave a node oldest first, so anything at least as new as its oldest item is still there
+	const TSharedPtr<FNode> Node = Entry.Node.Pin();
+	return Node.IsValid() && Node->Items.Num() > 0 && Entry.Stamp >= Node->Items[Node->Head].Stamp;
+}
+
+void FChatPubSubRegistry::PushAge(const TSharedRef<FNode>& Node, uint64 Stamp)
+{
+	AgeQueue.Add(FAgeEntry(Node, Stamp));
+
+	// drop entries of items that are gone once they outnumber the cached ones, amortized O(1)
+	if (AgeQueue.Num() - AgeHead > 2 * NumCachedItems + 64)
+	{
+		TArray<FAgeEntry> Live;
+		Live.Reserve(NumCachedItems + 1);
+		for (int32 Idx = AgeHead; Idx < AgeQueue.Num(); ++Idx)
+		{
+			// the entry just pushed isn't in its node yet
+			if (Idx == AgeQueue.Num() - 1 || IsCached(AgeQueue[Idx]))
+			{
+				Live.Add(AgeQueue[Idx]);
+			}
+		}
+		AgeQueue = MoveTemp(Live);
+		AgeHead = 0;
+	}
+}
+
+void FChatPubSubRegistry::EvictOldest()
+{
+	// the first entry still cached is the oldest item over all nodes, and so the oldest of its node
+	while (AgeHead < AgeQueue.Num())
+	{
+		const FAgeEntry Entry = AgeQueue[AgeHead++];
+		if (AgeHead > 64 && AgeHead * 2 > AgeQueue.Num())
+		{
+			AgeQueue.RemoveAt(0, AgeHead, false);
+			AgeHead = 0;
+		}
+
+		if (IsCached(Entry))
+		{
+			const TSharedRef<FNode> Node = Entry.Node.Pin().ToSharedRef();
+			RemoveOldest(*Node, 1);
+			PruneNode(Node->NodeId);
+			return;
+		}
+	}
+
+	CachedBytes = 0;
+}
+
+void FChatPubSubRegistry::GetCachedItems(const FXmppPubSubId& NodeId, TArray<FChatPubSubItemRef>& OutItems) const
+{
+	OutItems.Empty();
+	if (const TSharedRef<FNode>* Node = Nodes.Find(NodeId))
+	{
+		const TArray<FCachedItem>& Items = (*Node)->Items;
+		OutItems.Reserve(Items.Num());
+		for (int32 Idx = 0; Idx < Items.Num(); ++Idx)
+		{
+			OutItems.Add(Items[((*Node)->Head + Idx) % Items.Num()].Item);
+		}
+	}
+}
+
+void FChatPubSubRegistry::ClearCache(const FXmppPubSubId& NodeId)
+{
+	if (TSharedRef<FNode>* Node = Nodes.Find(NodeId))
+	{
+		RemoveOldest(Node->Get(), (*Node)->Items.Num());
+		PruneNode(NodeId);
+	}
+}
+
+void FChatPubSubRegistry::PruneNode(const FXmppPubSubId& NodeId)
+{
+	const TSharedRef<FNode>* Node = Nodes.Find(NodeId);
+	if (Node != nullptr && (*Node)->Items.Num() == 0 && !(*Node)->Listeners.IsBound())
+	{
+		Nodes.Remove(NodeId);
+	}
+}
+
+void FChatPubSubRegistry::RemoveNode(const FXmppPubSubId& NodeId)
+{
+	ClearCache(NodeId);
+	Nodes.Remove(NodeId);
+}
+
+SIZE_T FChatPubSubRegistry::GetAllocatedSize() const
+{
+	SIZE_T Size = CachedBytes + Nodes.GetAllocatedSize() + AgeQueue.GetAllocatedSize();
+	for (const auto& Node : Nodes)
+	{
+		Size += Node.Key.GetAllocatedSize() * 2 + sizeof(FNode) + Node.Value->Items.GetAllocatedSize();
+	}
+	return Size;
+}
+
+SIZE_T FChatPubSubRegistry::GetItemSize(const FXmppPubSubMessage& Item)
+{
+	return sizeof(FXmppPubSubMessage) + Item.Payload.GetAllocatedSize()
+		+ Item.FromJid.Id.GetAllocatedSize() + Item.FromJid.Domain.GetAllocatedSize() + Item.FromJid.Resource.GetAllocatedSize()
+		+ Item.ToJid.Id.GetAllocatedSize() + Item.ToJid.Domain.GetAllocatedSize() + Item.ToJid.Resource.GetAllocatedSize();
+}
+
+/***************** Publisher **************************/
+
+void FChatPubSubPublisher::Publish(IXmppPubSub& PubSub, const FXmppPubSubId& NodeId, const FString& Payload, const FChatPubSubPublishSettings& Settings, double Now, FChatPubSubCounters& Counters)
+{
+	const int32 PayloadBytes = ChatPubSubWire::Utf8Len(Payload);
+	Counters.PublishRequests++;
+	Counters.BytesRequested += PayloadBytes;
+	INC_DWORD_STAT(STAT_ChatPubSubPublishRequests);
+
+	FNodeState* Found = Nodes.Find(NodeId);
+	if (Found == nullptr)
+	{
+		while (Settings.MaxNodes > 0 && Nodes.Num() >= Settings.MaxNodes)
+		{
+			EvictOldest(PubSub, Settings, Counters);
+		}
+		Found = &Nodes.Add(NodeId, FNodeState());
+		Found->LruHandle = PublishOrder.Add(NodeId);
+	}
+
+	FNodeState& State = *Found;
+	PublishOrder.Touch(State.LruHandle);
+
+	if (Settings.BatchWindow <= 0.0f)
+	{
+		if (State.bPending)
+		{
+			// batching was just turned off, the held value is superseded
+			State.bPending = false;
+			State.PendingPayload.Empty();
+			NumPending--;
+			Counters.PublishesCoalesced++;
+		}
+		Send(PubSub, NodeId, State, Payload, Settings, Counters);
+	}
+	else if (State.bPending)
+	{
+		State.PendingPayload = Payload;
+		Counters.PublishesCoalesced++;
+	}
+	else
+	{
+		State.PendingPayload = Payload;
+		State.bPending = true;
+		State.PendingSince = Now;
+		NumPending++;
+	}
+}
+
+void FChatPubSubPublisher::Flush(IXmppPubSub& PubSub, const FChatPubSubPublishSettings& Settings, double Now, bool bForce, FChatPubSubCounters& Counters)
+{
+	if (NumPending == 0)
+	{
+		return;
+	}
+
+	for (auto& Node : Nodes)
+	{
+		FNodeState& State = Node.Value;
+		if (State.bPending && (bForce || Now - State.PendingSince >= Settings.BatchWindow))
+		{
+			State.bPending = false;
+			NumPending--;
+
+			const FString Payload = MoveTemp(State.PendingPayload);
+			Send(PubSub, Node.Key, State, Payload, Settings, Counters);
+		}
+	}
+}
+
+void FChatPubSubPublisher::Send(IXmppPubSub& PubSub, const FXmppPubSubId& NodeId, FNodeState& State, const FString& Payload, const FChatPubSubPublishSettings& Settings, FChatPubSubCounters& Counters)
+{
+	FXmppPubSubMessage Message;
+
+	if (Settings.bDeltaEncoding)
+	{
+		State.Sequence++;
+
+		Message.Payload = ChatPubSubWire::EncodeKeyframe(State.Sequence, Payload);
+
+		bool bKeyframe = true;
+		if (State.bHasLastSent && State.SinceKeyframe + 1 < Settings.KeyframeInterval)
+		{
+			FString Delta = ChatPubSubWire::EncodeDelta(State.Sequence, State.LastSent, Payload);
+			if (Delta.Len() < Message.Payload.Len())
+			{
+				Message.Payload = MoveTemp(Delta);
+				bKeyframe = false;
+			}
+		}
+
+		if (bKeyframe)
+		{
+			State.SinceKeyframe = 0;
+			Counters.KeyframesSent++;
+		}
+		else
+		{
+			State.SinceKeyframe++;
+			Counters.DeltasSent++;
+		}
+
+		State.LastSent = Payload;
+		State.bHasLastSent = true;
+	}
+	else
+	{
+		Message.Payload = Payload.StartsWith(ChatPubSubWire::Marker, ESearchCase::CaseSensitive)
+			? FString(ChatPubSubWire::Marker) + TEXT("R|") + Payload
+			: Payload;
+
+		// the next delta, if it gets turned on, must start from a keyframe
+		State.LastSent.Empty();
+		State.bHasLastSent = false;
+	}
+
+	const int32 WireBytes = ChatPubSubWire::Utf8Len(Message.Payload);
+	Counters.PublishesSent++;
+	Counters.BytesSent += WireBytes;
+	INC_DWORD_STAT(STAT_ChatPubSubPublishesSent);
+	INC_DWORD_STAT_BY(STAT_ChatPubSubBytesSent, WireBytes);
+
+	PubSub.PublishMessage(NodeId, Message);
+}
+
+void FChatPubSubPublisher::RemoveNode(const FXmppPubSubId& NodeId)
+{
+	if (FNodeState* State = Nodes.Find(NodeId))
+	{
+		if (State->bPending)
+		{
+			NumPending--;
+		}
+		PublishOrder.Remove(State->LruHandle);
+		Nodes.Remove(NodeId);
+	}
+}
+
+void FChatPubSubPublisher::EvictOldest(IXmppPubSub& PubSub, const FChatPubSubPublishSettings& Settings, FChatPubSubCounters& Counters)
+{
+	if (PublishOrder.Num() > 0)
+	{
+		const FXmppPubSubId NodeId = *PublishOrder.GetOldest();
+		FNodeState& Oldest = Nodes.FindChecked(NodeId);
+		if (Oldest.bPending)
+		{
+			// don't lose the latest value, only the state kept for batching and deltas
+			Oldest.bPending = false;
+			NumPending--;
+
+			const FString Payload = MoveTemp(Oldest.PendingPayload);
+			Send(PubSub, NodeId, Oldest, Payload, Settings, Counters);
+		}
+		PublishOrder.Remove(Oldest.LruHandle);
+		Nodes.Remove(NodeId);
+	}
+}
+
+SIZE_T FChatPubSubPublisher::GetAllocatedSize() const
+{
+	SIZE_T Size = Nodes.GetAllocatedSize() + PublishOrder.GetAllocatedSize();
+	for (const auto& Node : Nodes)
+	{
+		// the key is also held by PublishOrder
+		Size += Node.Key.GetAllocatedSize() * 2 + Node.Value.PendingPayload.GetAllocatedSize() + Node.Value.LastSent.GetAllocatedSize();
+	}
+	return Size;
+}
+
+/***************** Decoder **************************/
+
+TSharedPtr<const FXmppPubSubMessage> FChatPubSubDecoder::Decode(const FXmppPubSubId& NodeId, const TSharedRef<FXmppPubSubMessage>& Item, int32 MaxStreams, FChatPubSubCounters& Counters)
+{
+	const FString& Wire = Item->Payload;
+	const int32 WireBytes = ChatPubSubWire::Utf8Len(Wire);
+	Counters.ItemsReceived++;
+	Counters.BytesReceived += WireBytes;
+	INC_DWORD_STAT(STAT_ChatPubSubItemsReceived);
+	INC_DWORD_STAT_BY(STAT_ChatPubSubBytesReceived, WireBytes);
+
+	if (!Wire.StartsWith(ChatPubSubWire::Marker, ESearchCase::CaseSensitive) || Wire.Len() < ChatPubSubWire::MarkerLen + 2)
+	{
+		return Item;
+	}
+
+	const TCHAR Kind = Wire[ChatPubSubWire::MarkerLen];
+	int32 Pos = ChatPubSubWire::MarkerLen + 2;
+
+	if (Kind == TEXT('R') && Wire[ChatPubSubWire::MarkerLen + 1] == TEXT('|'))
+	{
+		TSharedRef<FXmppPubSubMessage> Unescaped = MakeShareable(new FXmppPubSubMessage(*Item));
+		Unescaped->Payload = Wire.Mid(Pos);
+		return Unescaped;
+	}
+
+	uint32 Sequence = 0;
+	if ((Kind != TEXT('K') && Kind != TEXT('D')) || Wire[ChatPubSubWire::MarkerLen + 1] != TEXT('|') || !ChatPubSubWire::ParseField(Wire, Pos, Sequence))
+	{
+		// looks like ours but isn't, hand it over as is
+		return Item;
+	}
+
+	const FString Publisher = Item->FromJid.GetFullPath();
+	TMap<FString, FPublisherState>* Publishers = Nodes.Find(NodeId);
+	FPublisherState* Found = Publishers != nullptr ? Publishers->Find(Publisher) : nullptr;
+	if (Found == nullptr)
+	{
+		while (MaxStreams > 0 && ActiveOrder.Num() >= MaxStreams)
+		{
+			EvictOldest();
+		}
+		Found = &Nodes.FindOrAdd(NodeId).Add(Publisher, FPublisherState());
+		Found->LruHandle = ActiveOrder.Add(FStreamKey(NodeId, Publisher));
+	}
+
+	FPublisherState& State = *Found;
+	ActiveOrder.Touch(State.LruHandle);
+
+	TSharedRef<FXmppPubSubMessage> Decoded = MakeShareable(new FXmppPubSubMessage(*Item));
+
+	if (Kind == TEXT('K'))
+	{
+		Decoded->Payload = Wire.Mid(Pos);
+		ChatPubSubWire::ToUtf8(Decoded->Payload, State.Payload);
+	}
+	else
+	{
+		uint32 Prefix = 0;
+		uint32 Suffix = 0;
+		if (!State.bValid || State.Sequence + 1 != Sequence
+			|| !ChatPubSubWire::ParseField(Wire, Pos, Prefix) || !ChatPubSubWire::ParseField(Wire, Pos, Suffix)
+			|| Prefix + Suffix > static_cast<uint32>(State.Payload.Num()))
+		{
+			// missed the base item, wait for the next keyframe
+			State.bValid = false;
+			Counters.DeltasDropped++;
+			return nullptr;
+		}
+
+		TArray<ANSICHAR> Middle;
+		ChatPubSubWire::ToUtf8(Wire.Mid(Pos), Middle);
+
+		TArray<ANSICHAR> Payload;
+		Payload.Reserve(Prefix + Middle.Num() + Suffix);
+		Payload.Append(State.Payload.GetData(), Prefix);
+		Payload.Append(Middle);
+		Payload.Append(State.Payload.GetData() + State.Payload.Num() - Suffix, Suffix);
+		State.Payload = MoveTemp(Payload);
+
+		Decoded->Payload = ChatPubSubWire::FromUtf8(State.Payload.GetData(), State.Payload.Num());
+		Counters.DeltasApplied++;
+	}
+
+	State.bValid = true;
+	State.Sequence = Sequence;
+	return Decoded;
+}
+
+void FChatPubSubDecoder::RemoveNode(const FXmppPubSubId& NodeId)
+{
+	if (const TMap<FString, FPublisherState>* Publishers = Nodes.Find(NodeId))
+	{
+		for (const auto& Publisher : *Publishers)
+		{
+			ActiveOrder.Remove(Publisher.Value.LruHandle);
+		}
+		Nodes.Remove(NodeId);
+	}
+}
+
+void FChatPubSubDecoder::EvictOldest()
+{
+	if (ActiveOrder.Num() == 0)
+	{
+		return;
+	}
+
+	// the next delta from this publisher is dropped until its next keyframe
+	const FStreamKey Oldest = *ActiveOrder.GetOldest();
+	ActiveOrder.Remove(ActiveOrder.GetOldestHandle());
+
+	TMap<FString, FPublisherState>& Publishers = Nodes.FindChecked(Oldest.Key);
+	Publishers.Remove(Oldest.Value);
+	if (Publishers.Num() == 0)
+	{
+		Nodes.Remove(Oldest.Key);
+	}
+}
+
+SIZE_T FChatPubSubDecoder::GetAllocatedSize() const
+{
+	SIZE_T Size = Nodes.GetAllocatedSize() + ActiveOrder.GetAllocatedSize();
+	for (const auto& Node : Nodes)
+	{
+		Size += Node.Key.GetAllocatedSize() + Node.Value.GetAllocatedSize();
+		for (const auto& Publisher : Node.Value)
+		{
+			// node and publisher are also held by ActiveOrder
+			Size += Node.Key.GetAllocatedSize() + Publisher.Key.GetAllocatedSize() * 2 + Publisher.Value.Payload.GetAllocatedSize();
+		}
+	}
+	return Size;
+}
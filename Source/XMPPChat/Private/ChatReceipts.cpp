@@ -0,0 +1,146 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#include "XMPPChatPrivatePCH.h"
+#include "ChatReceipts.h"
+
+/***************** Histogram **************************/
+
+int32 FChatLatencyHistogram::GetBucket(double Milliseconds)
+{
+	// bucket 0 is below 1ms, bucket N covers [2^((N-1)/8), 2^(N/8)) ms
+	if (Milliseconds < 1.0)
+	{
+		return 0;
+	}
+	const int32 Bucket = 1 + FMath::FloorToInt(BucketsPerOctave * FMath::Log2(static_cast<float>(Milliseconds)));
+	return FMath::Clamp(Bucket, 1, NumBuckets - 1);
+}
+
+float FChatLatencyHistogram::GetBucketUpperMs(int32 Bucket)
+{
+	return FMath::Pow(2.0f, static_cast<float>(Bucket) / BucketsPerOctave);
+}
+
+void FChatLatencyHistogram::Add(double Seconds)
+{
+	Buckets[GetBucket(Seconds * 1000.0)].Increment();
+	NumSamples.Increment();
+}
+
+float FChatLatencyHistogram::GetPercentileMs(float Fraction) const
+{
+	const int32 Total = NumSamples.GetValue();
+	if (Total <= 0)
+	{
+		return 0.0f;
+	}
+
+	const int32 Rank = FMath::Max(1, FMath::CeilToInt(FMath::Clamp(Fraction, 0.0f, 1.0f) * Total));
+	int32 Seen = 0;
+	for (int32 Bucket = 0; Bucket < NumBuckets; ++Bucket)
+	{
+		Seen += Buckets[Bucket].GetValue();
+		if (Seen >= Rank)
+		{
+			return GetBucketUpperMs(Bucket);
+		}
+	}
+	// samples added while we were reading
+	return GetBucketUpperMs(NumBuckets - 1);
+}
+
+int32 FChatLatencyHistogram::GetNumSamples() const
+{
+	return NumSamples.GetValue();
+}
+
+void FChatLatencyHistogram::Reset()
+{
+	for (int32 Bucket = 0; Bucket < NumBuckets; ++Bucket)
+	{
+		Buckets[Bucket].Reset();
+	}
+	NumSamples.Reset();
+}
+
+/***************** Receipts **************************/
+
+FChatReceiptTracker::FChatReceiptTracker() :
+	SessionId(FString::Printf(TEXT("%08x"), FGuid::NewGuid().A)),
+	NextId(0),
+	OldestId(0),
+	NumTimedOut(0),
+	NumEvicted(0)
+{
+}
+
+FString FChatReceiptTracker::Track(double Now, int32 MaxPending)
+{
+	while (MaxPending > 0 && Pending.Num() >= MaxPending)
+	{
+		PopOldest();
+		NumEvicted++;
+	}
+
+	const uint32 Id = NextId++;
+	Pending.Add(Id, Now);
+	return FString::Printf(TEXT("%s-%x"), *SessionId, Id);
+}
+
+bool FChatReceiptTracker::IsOwnId(const FString& ReceiptId) const
+{
+	const int32 Prefix = SessionId.Len() + 1;
+	return ReceiptId.Len() > Prefix && ReceiptId.StartsWith(SessionId, ESearchCase::CaseSensitive) && ReceiptId[Prefix - 1] == TEXT('-');
+}
+
+bool FChatReceiptTracker::Complete(const FString& ReceiptId, double Now, FChatLatencyHistogram& Histogram)
+{
+	if (!IsOwnId(ReceiptId))
+	{
+		return false;
+	}
+
+	const int32 Prefix = SessionId.Len() + 1;
+	const uint32 Id = static_cast<uint32>(FCString::Strtoui64(*ReceiptId + Prefix, nullptr, 16));
+	double SentTime = 0.0;
+	if (!Pending.RemoveAndCopyValue(Id, SentTime))
+	{
+		return false;
+	}
+
+	Histogram.Add(Now - SentTime);
+	return true;
+}
+
+void FChatReceiptTracker::Expire(double Now, float Timeout)
+{
+	while (OldestId != NextId)
+	{
+		const double* SentTime = Pending.Find(OldestId);
+		if (SentTime == nullptr)
+		{
+			// already acked
+			OldestId++;
+		}
+		else if (Now - *SentTime >= Timeout)
+		{
+			Pending.Remove(OldestId++);
+			NumTimedOut++;
+		}
+		else
+		{
+			break;
+		}
+	}
+}
+
+void FChatReceiptTracker::PopOldest()
+{
+	while (OldestId != NextId)
+	{
+		if (Pending.Remove(OldestId++) > 0)
+		{
+			return;
+		}
+	}
+}
@@ -0,0 +1,106 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#include "XMPPChatPrivatePCH.h"
+#include "ChatRoomInfo.h"
+
+FChatRoomInfoCache::FEntry& FChatRoomInfoCache::FindOrAddEntry(const FXmppRoomId& RoomId, int32 MaxEntries)
+{
+	if (FEntry* Entry = Entries.Find(RoomId))
+	{
+		return *Entry;
+	}
+
+	while (MaxEntries > 0 && Entries.Num() >= MaxEntries)
+	{
+		const FXmppRoomId Oldest = *UseOrder.GetOldest();
+		UseOrder.Remove(UseOrder.GetOldestHandle());
+		Entries.Remove(Oldest);
+	}
+
+	FEntry& Entry = Entries.Add(RoomId, FEntry());
+	Entry.LruHandle = UseOrder.Add(RoomId);
+	return Entry;
+}
+
+bool FChatRoomInfoCache::BeginRefresh(const FXmppRoomId& RoomId, double Now, float TTL, float RequestTimeout, bool bForce, int32 MaxEntries)
+{
+	FEntry& Entry = FindOrAddEntry(RoomId, MaxEntries);
+
+	if (Entry.bInFlight && Now - Entry.RequestTime < RequestTimeout)
+	{
+		// coalesce with the request already out, even when forced
+		return false;
+	}
+
+	if (!bForce && Entry.bHasInfo && !Entry.bInvalidated && Now - Entry.FetchedTime < TTL)
+	{
+		return false;
+	}
+
+	Entry.bInFlight = true;
+	Entry.RequestTime = Now;
+	Entry.RequestGeneration = Entry.Generation;
+	UseOrder.Touch(Entry.LruHandle);
+	return true;
+}
+
+void FChatRoomInfoCache::CompleteRefresh(const FXmppRoomId& RoomId, bool bSuccess, const FXmppRoomInfo& Info, double Now, int32 MaxEntries)
+{
+	FEntry& Entry = FindOrAddEntry(RoomId, MaxEntries);
+	Entry.bInFlight = false;
+
+	if (bSuccess)
+	{
+		Entry.Info = Info;
+		Entry.bHasInfo = true;
+		Entry.bInvalidated = Entry.RequestGeneration != Entry.Generation;
+		Entry.FetchedTime = Now;
+		UseOrder.Touch(Entry.LruHandle);
+	}
+}
+
+void FChatRoomInfoCache::Invalidate(const FXmppRoomId& RoomId)
+{
+	if (FEntry* Entry = Entries.Find(RoomId))
+	{
+		// an answer already on its way may predate the change, it will be stored as stale
+		Entry->bInvalidated = true;
+		Entry->Generation++;
+	}
+}
+
+void FChatRoomInfoCache::InvalidateAll()
+{
+	for (auto& Entry : Entries)
+	{
+		// the connection changed, answers still in flight will never arrive
+		Entry.Value.bInvalidated = true;
+		Entry.Value.Generation++;
+		Entry.Value.bInFlight = false;
+	}
+}
+
+const FXmppRoomInfo* FChatRoomInfoCache::Find(const FXmppRoomId& RoomId, double Now, float TTL, bool& bOutIsStale, float& OutAge) const
+{
+	const FEntry* Entry = Entries.Find(RoomId);
+	if (Entry == nullptr || !Entry->bHasInfo)
+	{
+		return nullptr;
+	}
+
+	OutAge = static_cast<float>(Now - Entry->FetchedTime);
+	bOutIsStale = Entry->bInvalidated || OutAge >= TTL;
+	return &Entry->Info;
+}
+
+SIZE_T FChatRoomInfoCache::GetAllocatedSize() const
+{
+	SIZE_T Size = Entries.GetAllocatedSize() + UseOrder.GetAllocatedSize();
+	for (const auto& Entry : Entries)
+	{
+		// the key is also held by UseOrder
+		const FXmppRoomInfo& Info = Entry.Value.Info;
+		Size += Entry.Key.GetAllocatedSize() * 2 + Info.Id.GetAllocatedSize() + Info.OwnerId.GetAllocatedSize() + Info.Subject.GetAllocatedSize();
+	}
+	return Size;
+}
@@ -0,0 +1,241 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#include "XMPPChatPrivatePCH.h"
+#include "ChatSequence.h"
+
+FChatSequencer::FChatSequencer() :
+	SessionId(FString::Printf(TEXT("%08x"), FGuid::NewGuid().B)),
+	BufferedBytes(0),
+	NumDuplicates(0),
+	NumReordered(0),
+	NumSkipped(0)
+{
+}
+
+uint32 FChatSequencer::NextOutgoing(const FString& Destination)
+{
+	return ++Outgoing.FindOrAdd(Destination);
+}
+
+void FChatSequencer::Receive(const FString& StreamKey, const FString& Session, uint32 Sequence, FChatSequencedMessage&& Message, double Now, int32 MaxBuffered, int32 MaxBufferedBytes, int32 MaxStreams, TArray<FChatSequencedMessage>& OutReady)
+{
+	FStream* Stream = Streams.Find(StreamKey);
+	if (Stream == nullptr || Stream->Session != Session)
+	{
+		if (Stream != nullptr)
+		{
+			// sender restarted, whatever was waiting on the old session won't get any more complete
+			FlushAll(*Stream, OutReady);
+
+			const int32 ActiveHandle = Stream->ActiveHandle;
+			*Stream = FStream();
+			Stream->ActiveHandle = ActiveHandle;
+		}
+		else
+		{
+			while (MaxStreams > 0 && Streams.Num() >= MaxStreams)
+			{
+				EvictOldest(OutReady);
+			}
+			Stream = &Streams.Add(StreamKey, FStream());
+			Stream->ActiveHandle = ActiveOrder.Add(StreamKey);
+		}
+		Stream->Session = Session;
+		Stream->NextExpected = Sequence;
+
+		// senders count from 1, anything later may have overtaken earlier messages, so hold it for a bit
+		Stream->bOpenStart = Sequence > 1;
+	}
+
+	ActiveOrder.Touch(Stream->ActiveHandle);
+
+	uint32 Offset = Sequence - Stream->NextExpected;
+	if (static_cast<int32>(Offset) < 0)
+	{
+		const uint32 Behind = Stream->NextExpected - Sequence;
+		if (!Stream->bOpenStart || Behind >= WindowSize || Stream->Buffered.Num() == 0 || Stream->Buffered.Last().Sequence - Sequence >= WindowSize)
+		{
+			// delivered or given up on already
+			NumDuplicates++;
+			return;
+		}
+
+		// an earlier message of a stream we only just started on, move the start back to it
+		Stream->NextExpected = Sequence;
+		Stream->BufferedBits <<= Behind;
+		Offset = 0;
+	}
+
+	if (Offset == 0 && !Stream->bOpenStart)
+	{
+		OutReady.Add(MoveTemp(Message));
+		Advance(*Stream, 1);
+		Drain(*Stream, OutReady);
+	}
+	else if (Offset < WindowSize)
+	{
+		const uint64 Bit = 1ull << Offset;
+		if (Stream->BufferedBits & Bit)
+		{
+			NumDuplicates++;
+			return;
+		}
+
+		if (Stream->GapHandle == INDEX_NONE)
+		{
+			Stream->GapSince = Now;
+			Stream->GapHandle = GapOrder.Add(StreamKey);
+		}
+
+		int32 Index = Stream->Buffered.Num();
+		while (Index > 0 && Stream->Buffered[Index - 1].Sequence - Stream->NextExpected > Offset)
+		{
+			--Index;
+		}
+		FBuffered Buffered;
+		Buffered.Sequence = Sequence;
+		Buffered.Bytes = GetMessageSize(Message);
+		Buffered.Message = MoveTemp(Message);
+		BufferedBytes += Buffered.Bytes;
+		Stream->Buffered.Insert(MoveTemp(Buffered), Index);
+		Stream->BufferedBits |= Bit;
+
+		if (Stream->Buffered.Num() > FMath::Clamp<int32>(MaxBuffered, 0, WindowSize - 1))
+		{
+			// waited on as many as we can hold, give up on the gap in front of them
+			SkipTo(*Stream, Stream->Buffered[0].Sequence, OutReady);
+		}
+
+		while (MaxBufferedBytes > 0 && BufferedBytes > static_cast<SIZE_T>(MaxBufferedBytes))
+		{
+			SkipOldestGap(OutReady);
+		}
+	}
+	else
+	{
+		// far ahead of anything we can buffer, take it as the new start of the stream
+		FlushAll(*Stream, OutReady);
+		Stream->bOpenStart = false;
+		NumSkipped += Sequence - Stream->NextExpected;
+		Stream->NextExpected = Sequence;
+		OutReady.Add(MoveTemp(Message));
+		Advance(*Stream, 1);
+	}
+}
+
+void FChatSequencer::Expire(double Now, float Timeout, TArray<FChatSequencedMessage>& OutReady)
+{
+	// oldest gap first, so stop at the first one still within its time; each is looked at once per call
+	for (int32 NumToCheck = GapOrder.Num(); NumToCheck > 0; --NumToCheck)
+	{
+		FStream& Stream = Streams.FindChecked(*GapOrder.GetOldest());
+		if (Now - Stream.GapSince < Timeout)
+		{
+			break;
+		}
+
+		SkipTo(Stream, Stream.Buffered[0].Sequence, OutReady);
+		if (Stream.GapHandle != INDEX_NONE)
+		{
+			// another gap behind the one we gave up on, give it its own time
+			Stream.GapSince = Now;
+			GapOrder.Touch(Stream.GapHandle);
+		}
+	}
+}
+
+void FChatSequencer::Advance(FStream& Stream, uint32 Count)
+{
+	Stream.NextExpected += Count;
+	Stream.BufferedBits = Count < WindowSize ? Stream.BufferedBits >> Count : 0;
+}
+
+void FChatSequencer::Drain(FStream& Stream, TArray<FChatSequencedMessage>& OutReady)
+{
+	int32 NumReady = 0;
+	while (NumReady < Stream.Buffered.Num() && Stream.Buffered[NumReady].Sequence == Stream.NextExpected)
+	{
+		BufferedBytes -= Stream.Buffered[NumReady].Bytes;
+		OutReady.Add(MoveTemp(Stream.Buffered[NumReady].Message));
+		Advance(Stream, 1);
+		++NumReady;
+	}
+
+	if (NumReady > 0)
+	{
+		Stream.Buffered.RemoveAt(0, NumReady, false);
+		NumReordered += NumReady;
+
+		if (Stream.Buffered.Num() == 0)
+		{
+			GapOrder.Remove(Stream.GapHandle);
+			Stream.GapHandle = INDEX_NONE;
+		}
+	}
+}
+
+void FChatSequencer::SkipTo(FStream& Stream, uint32 Sequence, TArray<FChatSequencedMessage>& OutReady)
+{
+	// waited long enough for anything earlier, the start of the stream is settled
+	Stream.bOpenStart = false;
+
+	NumSkipped += Sequence - Stream.NextExpected;
+	Advance(Stream, Sequence - Stream.NextExpected);
+	Drain(Stream, OutReady);
+}
+
+void FChatSequencer::FlushAll(FStream& Stream, TArray<FChatSequencedMessage>& OutReady)
+{
+	while (Stream.Buffered.Num() > 0)
+	{
+		SkipTo(Stream, Stream.Buffered[0].Sequence, OutReady);
+	}
+}
+
+void FChatSequencer::EvictOldest(TArray<FChatSequencedMessage>& OutReady)
+{
+	if (ActiveOrder.Num() > 0)
+	{
+		const FString Key = *ActiveOrder.GetOldest();
+		FStream& Oldest = Streams.FindChecked(Key);
+		FlushAll(Oldest, OutReady);
+
+		ActiveOrder.Remove(Oldest.ActiveHandle);
+		Streams.Remove(Key);
+	}
+}
+
+void FChatSequencer::SkipOldestGap(TArray<FChatSequencedMessage>& OutReady)
+{
+	if (GapOrder.Num() > 0)
+	{
+		FStream& Oldest = Streams.FindChecked(*GapOrder.GetOldest());
+		SkipTo(Oldest, Oldest.Buffered[0].Sequence, OutReady);
+	}
+	else
+	{
+		BufferedBytes = 0;
+	}
+}
+
+SIZE_T FChatSequencer::GetMessageSize(const FChatSequencedMessage& Message)
+{
+	return Message.Channel.GetAllocatedSize() + Message.Sender.GetAllocatedSize() + Message.Body.GetAllocatedSize();
+}
+
+SIZE_T FChatSequencer::GetAllocatedSize() const
+{
+	SIZE_T Size = SessionId.GetAllocatedSize() + Outgoing.GetAllocatedSize() + Streams.GetAllocatedSize() + ActiveOrder.GetAllocatedSize() + GapOrder.GetAllocatedSize();
+	for (const auto& Destination : Outgoing)
+	{
+		Size += Destination.Key.GetAllocatedSize();
+	}
+	for (const auto& Stream : Streams)
+	{
+		// the key is also held by ActiveOrder, and by GapOrder while there is a gap
+		const int32 KeyCopies = Stream.Value.GapHandle != INDEX_NONE ? 3 : 2;
+		Size += Stream.Key.GetAllocatedSize() * KeyCopies + Stream.Value.Session.GetAllocatedSize() + Stream.Value.Buffered.GetAllocatedSize();
+	}
+	Size += BufferedBytes;
+	return Size;
+}
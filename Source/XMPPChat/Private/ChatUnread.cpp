@@ -0,0 +1,230 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#include "XMPPChatPrivatePCH.h"
+#include "ChatUnread.h"
+
+/***************** Mentions **************************/
+
+bool FChatMentionMatcher::IsNameChar(TCHAR Char)
+{
+	return FChar::IsAlnum(Char) || Char == TEXT('_');
+}
+
+void FChatMentionMatcher::SetNames(const TArray<FString>& InNames)
+{
+	Names.Empty(InNames.Num());
+	Lengths.Empty();
+
+	for (const FString& Name : InNames)
+	{
+		FString Trimmed = Name.Trim().TrimTrailing();
+		if (Trimmed.StartsWith(TEXT("@")))
+		{
+			Trimmed = Trimmed.Mid(1);
+		}
+		if (!Trimmed.IsEmpty())
+		{
+			Lengths.AddUnique(Trimmed.Len());
+			Names.Add(MoveTemp(Trimmed));
+		}
+	}
+
+	Lengths.Sort([](int32 A, int32 B) { return A > B; });
+}
+
+bool FChatMentionMatcher::Matches(const FString& Body, const FString& ExtraName) const
+{
+	if (Names.Num() == 0 && ExtraName.IsEmpty())
+	{
+		return false;
+	}
+
+	const TCHAR* Chars = *Body;
+	const int32 Len = Body.Len();
+
+	for (int32 At = 0; At < Len; ++At)
+	{
+		// an '@' that starts a word
+		if (Chars[At] != TEXT('@') || (At > 0 && IsNameChar(Chars[At - 1])))
+		{
+			continue;
+		}
+
+		const int32 Start = At + 1;
+		auto IsMatchEnd = [&](int32 NameLen)
+		{
+			return Start + NameLen == Len || !IsNameChar(Chars[Start + NameLen]);
+		};
+
+		const int32 ExtraLen = ExtraName.Len();
+		if (ExtraLen > 0 && Start + ExtraLen <= Len && IsMatchEnd(ExtraLen) && FCString::Strnicmp(Chars + Start, *ExtraName, ExtraLen) == 0)
+		{
+			return true;
+		}
+
+		for (const int32 NameLen : Lengths)
+		{
+			if (Start + NameLen <= Len && IsMatchEnd(NameLen) && Names.Contains(FString(NameLen, Chars + Start)))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/***************** Unread **************************/
+
+void FChatUnreadTracker::SetChanged(const FString& Channel, FChannel& State)
+{
+	if (!State.bChanged)
+	{
+		State.bChanged = true;
+		Changed.Add(Channel);
+	}
+}
+
+void FChatUnreadTracker::DropMentions(FChannel& State, int32 Count)
+{
+	State.MentionHead += Count;
+
+	// compact once the read part outweighs the unread part, amortized O(1)
+	if (State.MentionHead > 16 && State.MentionHead * 2 > State.Mentions.Num())
+	{
+		State.Mentions.RemoveAt(0, State.MentionHead, false);
+		State.MentionHead = 0;
+	}
+}
+
+int32 FChatUnreadTracker::Add(const FString& Channel, bool bMention, int32 MaxMentions, int32 MaxChannels)
+{
+	FChannel* Found = Channels.Find(Channel);
+	if (Found == nullptr)
+	{
+		while (MaxChannels > 0 && Channels.Num() >= MaxChannels)
+		{
+			EvictOldest();
+		}
+		Found = &Channels.Add(Channel, FChannel());
+		Found->LruHandle = ActiveOrder.Add(Channel);
+
+		// removed earlier this frame, so already listed as changed
+		Found->bChanged = RemovedChanged.Remove(Channel) > 0;
+	}
+
+	FChannel& State = *Found;
+	ActiveOrder.Touch(State.LruHandle);
+	State.LastIndex++;
+
+	if (bMention)
+	{
+		State.Mentions.Add(State.LastIndex);
+		if (MaxMentions > 0 && State.Mentions.Num() - State.MentionHead > MaxMentions)
+		{
+			// forget the oldest unread mention
+			DropMentions(State, 1);
+		}
+	}
+
+	SetChanged(Channel, State);
+	return State.LastIndex;
+}
+
+void FChatUnreadTracker::MarkRead(const FString& Channel, int32 UpToIndex)
+{
+	FChannel* State = Channels.Find(Channel);
+	if (State == nullptr)
+	{
+		return;
+	}
+
+	const int32 ReadIndex = UpToIndex < 0 ? State->LastIndex : FMath::Min(UpToIndex, State->LastIndex);
+	if (ReadIndex <= State->ReadIndex)
+	{
+		return;
+	}
+	State->ReadIndex = ReadIndex;
+	ActiveOrder.Touch(State->LruHandle);
+
+	int32 NumRead = 0;
+	while (State->MentionHead + NumRead < State->Mentions.Num() && State->Mentions[State->MentionHead + NumRead] <= ReadIndex)
+	{
+		++NumRead;
+	}
+	DropMentions(*State, NumRead);
+
+	SetChanged(Channel, *State);
+}
+
+bool FChatUnreadTracker::Get(const FString& Channel, int32& OutUnread, int32& OutMentions, int32& OutLastIndex) const
+{
+	const FChannel* State = Channels.Find(Channel);
+	if (State == nullptr)
+	{
+		OutUnread = 0;
+		OutMentions = 0;
+		OutLastIndex = 0;
+		return false;
+	}
+
+	OutUnread = State->LastIndex - State->ReadIndex;
+	OutMentions = State->Mentions.Num() - State->MentionHead;
+	OutLastIndex = State->LastIndex;
+	return true;
+}
+
+void FChatUnreadTracker::Remove(const FString& Channel)
+{
+	if (FChannel* State = Channels.Find(Channel))
+	{
+		if (!State->bChanged)
+		{
+			// still tell listeners the counts went away
+			Changed.Add(Channel);
+		}
+		RemovedChanged.Add(Channel);
+		ActiveOrder.Remove(State->LruHandle);
+		Channels.Remove(Channel);
+	}
+}
+
+void FChatUnreadTracker::EvictOldest()
+{
+	if (ActiveOrder.Num() > 0)
+	{
+		Remove(FString(*ActiveOrder.GetOldest()));
+	}
+}
+
+void FChatUnreadTracker::ConsumeChanged(TArray<FString>& OutChannels)
+{
+	for (const FString& Channel : Changed)
+	{
+		if (FChannel* State = Channels.Find(Channel))
+		{
+			State->bChanged = false;
+		}
+	}
+	OutChannels = MoveTemp(Changed);
+	Changed.Reset();
+	RemovedChanged.Reset();
+}
+
+SIZE_T FChatUnreadTracker::GetAllocatedSize() const
+{
+	SIZE_T Size = Channels.GetAllocatedSize() + Changed.GetAllocatedSize() + RemovedChanged.GetAllocatedSize() + ActiveOrder.GetAllocatedSize();
+	for (const auto& Channel : Channels)
+	{
+		// the key is also held by ActiveOrder
+		Size += Channel.Key.GetAllocatedSize() * 2 + Channel.Value.Mentions.GetAllocatedSize();
+	}
+	for (const FString& Channel : Changed)
+	{
+		Size += Channel.GetAllocatedSize();
+	}
+	for (const FString& Channel : RemovedChanged)
+	{
+		Size += Channel.GetAllocatedSize();
+	}
+	return Size;
+}
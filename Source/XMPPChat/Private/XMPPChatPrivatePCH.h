@@ -1,6 +1,9 @@
 // Copyright 1998-2015 Epic Games, Inc. All Rights Reserved.
 
+#include "Engine.h"
 #include "XMPPChat.h"
 
 // You should place include statements to your module's private header files here.  You only need to
-// add includes for headers that are used in most of your module's source files though.
\ No newline at end of file
+// add includes for headers that are used in most of your module's source files though.
+
+DECLARE_STATS_GROUP(TEXT("XMPPChat"), STATGROUP_XMPPChat, STATCAT_Advanced);
@@ -4,6 +4,11 @@
 
 #include "Engine.h"
 #include "Xmpp.h"
+#include "ChatPubSub.h"
+#include "ChatRoomInfo.h"
+#include "ChatReceipts.h"
+#include "ChatSequence.h"
+#include "ChatUnread.h"
 #include "Chat.generated.h"
 
 
@@ -123,6 +128,9 @@ DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnMUCRoomJoinPrivateComplete, bo
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnMUCRoomMemberJoin, const FString&, RoomId, const FString&, UserJid);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnMUCRoomMemberExit, const FString&, RoomId, const FString&, UserJid);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnMUCRoomMemberChanged, const FString&, RoomId, const FString&, UserJid);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnMUCRoomInfoRefreshed, bool, bSuccess, const FString&, RoomId, const FString&, Error);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnChatUnreadChanged, const TArray<FString>&, RoomIds, const TArray<FString>&, PeerIds);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FOnPubSubReceiveMessage, const FString&, NodeId, const FString&, FromJid, const FString&, Payload);
 
 /**
 * BP version of FXmppChatMember
@@ -165,9 +173,173 @@ public:
 	TEnumAsByte<EUChatMemberRole::Type> Affiliation;
 
 	void ConvertFrom(const FXmppChatMember& ChatMember);
+
+	/** heap bytes of this member, strings included */
+	SIZE_T GetAllocatedSize() const;
 };
 
 
+/**
+* BP version of FXmppRoomInfo
+* Cached info about a chat room
+*/
+USTRUCT(BlueprintType)
+struct FChatRoomInfo
+{
+	GENERATED_USTRUCT_BODY()
+
+	FChatRoomInfo();
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|MUC")
+	FString RoomId;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|MUC")
+	FString OwnerId;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|MUC")
+	FString Subject;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|MUC")
+	bool bIsPrivate;
+
+	/** older than the TTL or invalidated by a room change, MucRefresh will fetch it again */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|MUC")
+	bool bIsStale;
+
+	/** seconds since the info was fetched */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|MUC")
+	float Age;
+
+	void ConvertFrom(const FXmppRoomInfo& RoomInfo);
+};
+
+/**
+* BP view of FChatPubSubCounters
+* PubSub traffic through this chat, counts saturate at int32 max
+*/
+USTRUCT(BlueprintType)
+struct FChatPubSubStats
+{
+	GENERATED_USTRUCT_BODY()
+
+	FChatPubSubStats();
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|PubSub")
+	int32 PublishRequests;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|PubSub")
+	int32 PublishesSent;
+
+	/** publishes replaced by a newer value inside the batch window */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|PubSub")
+	int32 PublishesCoalesced;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|PubSub")
+	int32 KeyframesSent;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|PubSub")
+	int32 DeltasSent;
+
+	/** bytes that would have been sent by publishing every request in full */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|PubSub")
+	int32 BytesRequested;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|PubSub")
+	int32 BytesSent;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|PubSub")
+	int32 ItemsReceived;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|PubSub")
+	int32 DeltasApplied;
+
+	/** deltas received without their base item, state resumes at the next keyframe */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|PubSub")
+	int32 DeltasDropped;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|PubSub")
+	int32 BytesReceived;
+
+	void ConvertFrom(const FChatPubSubCounters& Counters);
+};
+
+/**
+* BP view of FChatLatencyHistogram and FChatReceiptTracker
+* Round trip times of chat messages sent with delivery receipts
+*/
+USTRUCT(BlueprintType)
+struct FChatLatencyStats
+{
+	GENERATED_USTRUCT_BODY()
+
+	FChatLatencyStats();
+
+	/** round trip percentiles in milliseconds, at bucket resolution (about 9%) */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Latency")
+	float P50;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Latency")
+	float P95;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Latency")
+	float P99;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Latency")
+	int32 NumSamples;
+
+	/** receipts still waiting for their ack */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Latency")
+	int32 NumPending;
+
+	/** receipts given up on after ReceiptTimeout */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Latency")
+	int32 NumTimedOut;
+
+	/** receipts dropped to stay under MaxPendingReceipts */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Latency")
+	int32 NumEvicted;
+};
+
+/**
+* Memory held by a chat, in bytes
+*/
+USTRUCT(BlueprintType)
+struct FChatMemoryStats
+{
+	GENERATED_USTRUCT_BODY()
+
+	FChatMemoryStats();
+
+	/** room member tables of the XMPP connection, and UChatMember objects converted from them */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Memory")
+	int32 MemberBytes;
+
+	/** received PubSub items kept for late listeners, and rebuilt delta state */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Memory")
+	int32 PubSubCacheBytes;
+
+	/** publishes held for batching, and the previous items deltas are made against */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Memory")
+	int32 PubSubQueueBytes;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Memory")
+	int32 RoomInfoBytes;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Memory")
+	int32 ReceiptBytes;
+
+	/** per sender sequence state and messages waiting to be reordered */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Memory")
+	int32 SequenceBytes;
+
+	/** unread and mention counters per room and peer */
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Memory")
+	int32 UnreadBytes;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Chat|Memory")
+	int32 TotalBytes;
+};
+
 /**
 * Chat class representing a connection to a chat server
 */
@@ -191,6 +363,56 @@ protected:
 	// has this chat been completed?
 	bool bDone;
 
+	// node-indexed listeners and last-item cache for received PubSub items
+	FChatPubSubRegistry PubSubRegistry;
+
+	// batching and delta encoding of outgoing PubSub items, and rebuilding of incoming ones
+	FChatPubSubPublisher PubSubPublisher;
+	FChatPubSubDecoder PubSubDecoder;
+	FChatPubSubCounters PubSubCounters;
+
+	FChatPubSubPublishSettings GetPubSubPublishSettings() const;
+
+	// room info by room id, so MucRefresh only goes to the server when the info is stale
+	FChatRoomInfoCache RoomInfoCache;
+
+	// receipts we're waiting on, and the round trip times of the ones that came back
+	FChatReceiptTracker ReceiptTracker;
+	FChatLatencyHistogram MessageLatency;
+
+	// sequence numbers for outgoing messages, dedupe and ordering of incoming ones
+	FChatSequencer Sequencer;
+
+	// wrap an outgoing chat body, asking for a receipt and stamping the next sequence number for SequenceKey if enabled
+	FString EncodeOutgoingBody(const FString& Body, const FString& SequenceKey);
+
+	// pass a received message through dedupe and reordering when it carries a sequence number
+	void ReceiveSequenced(const FString& StreamKey, const FString& Session, uint32 Sequence, FChatSequencedMessage&& Message);
+
+	// hand a received message, in order, to BP
+	void DeliverMessage(const FChatSequencedMessage& Message);
+
+	// unread and mention counts per room and per peer, changes are broadcast once per frame
+	FChatUnreadTracker RoomUnread;
+	FChatUnreadTracker PeerUnread;
+	FChatMentionMatcher MentionMatcher;
+
+	// our nickname in each joined room, for mentions and to not count our own messages as unread
+	TMap<FString, FString> RoomNicknames;
+
+	// nicknames of joins and creates still waiting for an answer, moved to RoomNicknames once they succeed
+	TMap<FString, FString> PendingRoomNicknames;
+	void CompleteRoomJoin(bool bSuccess, const FString& RoomId);
+
+	// per frame work: flushing batched publishes, timeouts
+	FDelegateHandle TickHandle;
+	bool TickChat(float DeltaTime);
+
+	// memory last added to the chat memory stat, and when it's next updated
+	int64 ReportedMemory;
+	double NextMemoryReportTime;
+	void ReportMemory(int64 Bytes);
+
 public:
 	// Delegates for BP events
 
@@ -227,6 +449,98 @@ public:
 	UPROPERTY(BlueprintAssignable, Category = "Chat|MUC")
 	FOnMUCRoomMemberChanged OnMUCRoomMemberChanged;
 
+	UPROPERTY(BlueprintAssignable, Category = "Chat|MUC")
+	FOnMUCRoomInfoRefreshed OnMUCRoomInfoRefreshed;
+
+	UPROPERTY(BlueprintAssignable, Category = "Chat|PubSub")
+	FOnPubSubReceiveMessage OnPubSubReceiveMessage;
+
+	/** unread or mention counts changed for these rooms and peers, at most once per frame */
+	UPROPERTY(BlueprintAssignable, Category = "Chat|Unread")
+	FOnChatUnreadChanged OnChatUnreadChanged;
+
+	// Settings
+
+	/** most unread mentions remembered per room or peer, the oldest are forgotten past this; 0 for no limit */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Unread")
+	int32 MaxUnreadMentions;
+
+	/** most peers with tracked private chat unread counts, the least recently active is forgotten past this; 0 for no limit */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Unread")
+	int32 MaxUnreadPeers;
+
+	/** most bytes of received PubSub items cached over all nodes, the oldest items go first past this; 0 for no limit */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Memory")
+	int32 MaxPubSubCacheBytes;
+
+	/** most rooms with cached info, the least recently refreshed goes first past this; 0 for no limit */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Memory")
+	int32 MaxRoomInfoEntries;
+
+	/** most senders with tracked sequence numbers, the least recently heard from goes first past this; 0 for no limit */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Memory")
+	int32 MaxSequenceStreams;
+
+	/** most bytes of received messages held waiting for gaps over all senders, the oldest gap is given up on first past this; 0 for no limit */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Memory")
+	int32 MaxReorderBufferBytes;
+
+	/** most PubSub nodes with publish batching and delta state, the least recently published to goes first past this; 0 for no limit */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Memory")
+	int32 MaxPubSubPublishNodes;
+
+	/** most PubSub publishers whose last full payload is kept to apply deltas, the least recently heard from goes first past this; 0 for no limit */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Memory")
+	int32 MaxPubSubDeltaStreams;
+
+	/** stamp PrivateChat and MucChat messages with sequence numbers so receivers using this plugin drop duplicates and restore order */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Message")
+	bool bSequenceMessages;
+
+	/** seconds a received message waits for an earlier missing one before the gap is given up on */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Message")
+	float ReorderTimeout;
+
+	/** most received messages held per sender waiting for a gap to fill (max 63) */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Message")
+	int32 MaxReorderBuffer;
+
+	/** ask for delivery receipts on PrivateChat, Message and MucChat to measure round trip times */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Latency")
+	bool bDeliveryReceipts;
+
+	/** seconds to wait for a receipt before giving up on it */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Latency")
+	float ReceiptTimeout;
+
+	/** most receipts waited on at once, the oldest is dropped past this */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|Latency")
+	int32 MaxPendingReceipts;
+
+	/** seconds cached room info is used before MucRefresh asks the server again */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|MUC")
+	float RoomInfoTTL;
+
+	/** seconds to wait for a room info answer before another MucRefresh may send a new request */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|MUC")
+	float RoomInfoRequestTimeout;
+
+	/** number of received items remembered per PubSub node for late listeners, 0 disables the cache */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|PubSub")
+	int32 PubSubCacheSize;
+
+	/** seconds to hold publishes per node so only the latest value is sent, 0 publishes immediately */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|PubSub")
+	float PubSubBatchWindow;
+
+	/** publish only the difference against the previous item; subscribers using this plugin rebuild the full payload */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|PubSub")
+	bool bPubSubDeltaEncoding;
+
+	/** with delta encoding, publish the full payload every this many items */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Chat|PubSub")
+	int32 PubSubKeyframeInterval;
+
 public:
 	// Callbacks for delegates
 
@@ -238,12 +552,16 @@ public:
 	void OnPrivateChatReceiveMessageFunc(const TSharedRef<IXmppConnection>& Connection, const FXmppUserJid& FromJid, const TSharedRef<FXmppChatMessage>& Message);
 
 	void OnMUCReceiveMessageFunc(const TSharedRef<IXmppConnection>& Connection, const FXmppRoomId& RoomId, const FXmppUserJid& UserJid, const TSharedRef<FXmppChatMessage>& ChatMsg);
+	void OnMUCRoomCreateCompleteFunc(const TSharedRef<IXmppConnection>& Connection, bool bSuccess, const FXmppRoomId& RoomId, const FString& Error);
 	void OnMUCRoomJoinPublicCompleteFunc(const TSharedRef<IXmppConnection>& Connection, bool bSuccess, const FXmppRoomId& RoomId, const FString& Error);
 	void OnMUCRoomJoinPrivateCompleteFunc(const TSharedRef<IXmppConnection>& Connection, bool bSuccess, const FXmppRoomId& RoomId, const FString& Error);
 
 	void OnMUCRoomMemberJoinFunc(const TSharedRef<IXmppConnection>& Connection, const FXmppRoomId& RoomId, const FXmppUserJid& UserJid);
 	void OnMUCRoomMemberExitFunc(const TSharedRef<IXmppConnection>& Connection, const FXmppRoomId& RoomId, const FXmppUserJid& UserJid);
 	void OnMUCRoomMemberChangedFunc(const TSharedRef<IXmppConnection>& Connection, const FXmppRoomId& RoomId, const FXmppUserJid& UserJid);
+	void OnMUCRoomInfoRefreshedFunc(const TSharedRef<IXmppConnection>& Connection, bool bSuccess, const FXmppRoomId& RoomId, const FString& Error);
+
+	void OnPubSubMessageReceivedFunc(const TSharedRef<IXmppConnection>& Connection, const FXmppPubSubId& NodeId, const TSharedRef<FXmppPubSubMessage>& Message);
 
 protected:
 	FDelegateHandle OnLoginCompleteHandle;
@@ -252,11 +570,14 @@ protected:
 	FDelegateHandle	OnPrivateChatReceiveMessageHandle;
 	FDelegateHandle OnChatReceiveMessageHandle;
 	FDelegateHandle OnMUCReceiveMessageHandle;
+	FDelegateHandle OnMUCRoomCreateCompleteHandle;
 	FDelegateHandle OnMUCRoomJoinPublicCompleteHandle;
 	FDelegateHandle OnMUCRoomJoinPrivateCompleteHandle;
 	FDelegateHandle OnMUCRoomMemberJoinHandle;
 	FDelegateHandle OnMUCRoomMemberExitHandle;
 	FDelegateHandle OnMUCRoomMemberChangedHandle;
+	FDelegateHandle OnMUCRoomInfoRefreshedHandle;
+	FDelegateHandle OnPubSubMessageReceivedHandle;
 
 protected:
 	void Init();
@@ -288,6 +609,49 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Chat|Message")
 	void PrivateChat(const FString& UserName, const FString& Recipient, const FString& Body);
 
+	/** messages dropped as duplicates, delivered after waiting for an earlier one, and missing ones given up on */
+	UFUNCTION(BlueprintCallable, Category = "Chat|Message")
+	void GetMessageSequenceStats(int32& Duplicates, int32& Reordered, int32& Skipped);
+
+	/** round trip percentiles of messages sent with delivery receipts */
+	UFUNCTION(BlueprintCallable, Category = "Chat|Latency")
+	void GetMessageLatency(FChatLatencyStats& Stats);
+
+	UFUNCTION(BlueprintCallable, Category = "Chat|Latency")
+	void ResetMessageLatency();
+
+	/***************** Unread **************************/
+
+	/** names besides our room nickname that count as an @mention, e.g. a display name */
+	UFUNCTION(BlueprintCallable, Category = "Chat|Unread")
+	void SetMentionAliases(const TArray<FString>& Aliases);
+
+	/** unread messages and mentions in a room; LastIndex is the index of the newest message, for MucMarkRead */
+	UFUNCTION(BlueprintCallable, Category = "Chat|Unread")
+	void MucGetUnread(const FString& RoomId, int32& Unread, int32& Mentions, int32& LastIndex);
+
+	/** mark messages in a room read up to and including UpToIndex, or all of them if UpToIndex is negative */
+	UFUNCTION(BlueprintCallable, Category = "Chat|Unread")
+	void MucMarkRead(const FString& RoomId, int32 UpToIndex = -1);
+
+	/** unread private messages and mentions from a peer (user id); LastIndex is the index of the newest message, for PrivateChatMarkRead */
+	UFUNCTION(BlueprintCallable, Category = "Chat|Unread")
+	void PrivateChatGetUnread(const FString& UserId, int32& Unread, int32& Mentions, int32& LastIndex);
+
+	/** mark private messages from a peer read up to and including UpToIndex, or all of them if UpToIndex is negative */
+	UFUNCTION(BlueprintCallable, Category = "Chat|Unread")
+	void PrivateChatMarkRead(const FString& UserId, int32 UpToIndex = -1);
+
+	/** forget unread counts for a peer, e.g. when their conversation is closed */
+	UFUNCTION(BlueprintCallable, Category = "Chat|Unread")
+	void PrivateChatClearUnread(const FString& UserId);
+
+	/***************** Memory **************************/
+
+	/** bytes held by this chat, also available as the XmppChat.Memory console command */
+	UFUNCTION(BlueprintCallable, Category = "Chat|Memory")
+	void GetMemoryUsage(FChatMemoryStats& Stats);
+
 	/***************** Presence **************************/
 
 	UFUNCTION(BlueprintCallable, Category = "Chat|Presence")
@@ -316,8 +680,13 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Chat|MUC")
 	void MucConfig(const FString& UserName, const FString& RoomId, bool bIsPrivate, const FString& Password);
 
+	/** refresh room info from the server, unless the cached info is younger than RoomInfoTTL or a refresh is already in flight */
+	UFUNCTION(BlueprintCallable, Category = "Chat|MUC")
+	void MucRefresh(const FString& RoomId, bool bForce = false);
+
+	/** room info from the last refresh, without a server round trip; false if the room was never refreshed */
 	UFUNCTION(BlueprintCallable, Category = "Chat|MUC")
-	void MucRefresh(const FString& RoomId);
+	bool MucGetCachedRoomInfo(const FString& RoomId, FChatRoomInfo& RoomInfo);
 
 	UFUNCTION(BlueprintCallable, Category = "Chat|MUC")
 	void MucGetMembers(const FString& RoomId, TArray<UChatMember*>& Members);
@@ -338,4 +707,20 @@ public:
 
 	UFUNCTION(BlueprintCallable, Category = "Chat|PubSub")
 	void PubSubPublish(const FString& NodeId, const FString& Payload);
+
+	/** send publishes held by PubSubBatchWindow right away */
+	UFUNCTION(BlueprintCallable, Category = "Chat|PubSub")
+	void PubSubFlush();
+
+	UFUNCTION(BlueprintCallable, Category = "Chat|PubSub")
+	void PubSubGetStats(FChatPubSubStats& Stats);
+
+	/** payloads of the last items received on a node, oldest first, without a server round trip */
+	UFUNCTION(BlueprintCallable, Category = "Chat|PubSub")
+	void PubSubGetCachedItems(const FString& NodeId, TArray<FString>& Payloads);
+
+	/** native listener for items received on a node, optionally replaying the cached items to it first */
+	FDelegateHandle PubSubAddListener(const FString& NodeId, const FOnChatPubSubItem::FDelegate& Listener, bool bReplayCached = true);
+
+	void PubSubRemoveListener(const FString& NodeId, FDelegateHandle Handle);
 };
\ No newline at end of file
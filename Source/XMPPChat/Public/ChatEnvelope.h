@@ -0,0 +1,34 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#pragma once
+
+#include "Engine.h"
+
+/**
+* Plugin metadata carried in front of a chat body, since the XMPP module only sends the body text.
+* On the wire: ~xc|key=value;key=value|body
+* Bodies without metadata are sent untouched unless they start with the marker themselves,
+* then they go out with an empty envelope (~xc||body). Unknown keys are ignored on receive
+*/
+struct FChatEnvelope
+{
+	/** sender wants a receipt for this message */
+	FString ReceiptId;
+
+	/** this message is the receipt for ReceiptId of a message we sent */
+	FString AckId;
+
+	/** sender's session and its sequence number for this message, for dedupe and ordering */
+	FString SequenceSession;
+	uint32 Sequence;
+
+	FChatEnvelope() : Sequence(0) {}
+
+	bool IsEmpty() const;
+
+	/** Body with this envelope in front, or the body as is (escaped if needed) if the envelope is empty */
+	FString Encode(const FString& Body) const;
+
+	/** Split a received body into envelope and body. False, with OutBody = Wire, if it carries no envelope */
+	static bool Decode(const FString& Wire, FChatEnvelope& OutEnvelope, FString& OutBody);
+};
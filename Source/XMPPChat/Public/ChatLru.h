@@ -0,0 +1,141 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#pragma once
+
+#include "Engine.h"
+
+/**
+* Keys in least to most recently used order, for O(1) eviction under a cap.
+* Links live in one array and are addressed by handle, so touching an entry moves it
+* to the back without allocating. The owner keeps the handle next to its own entry
+*/
+template<typename KeyType>
+class TChatLruList
+{
+public:
+	TChatLruList() : Head(INDEX_NONE), Tail(INDEX_NONE), FreeHead(INDEX_NONE), Count(0) {}
+
+	/** Append a key as the most recently used, returning its handle */
+	int32 Add(const KeyType& Key)
+	{
+		int32 Handle = FreeHead;
+		if (Handle != INDEX_NONE)
+		{
+			FreeHead = Links[Handle].Next;
+			Links[Handle].Key = Key;
+		}
+		else
+		{
+			Handle = Links.Num();
+			FLink& Link = Links[Links.AddDefaulted()];
+			Link.Key = Key;
+		}
+		LinkAtTail(Handle);
+		Count++;
+		return Handle;
+	}
+
+	/** Make the entry the most recently used */
+	void Touch(int32 Handle)
+	{
+		if (Handle != Tail)
+		{
+			Unlink(Handle);
+			LinkAtTail(Handle);
+		}
+	}
+
+	void Remove(int32 Handle)
+	{
+		Unlink(Handle);
+		Links[Handle].Key = KeyType();
+		Links[Handle].Next = FreeHead;
+		FreeHead = Handle;
+		Count--;
+	}
+
+	/** Least recently used key, or null if empty */
+	const KeyType* GetOldest() const
+	{
+		return Head != INDEX_NONE ? &Links[Head].Key : nullptr;
+	}
+
+	int32 GetOldestHandle() const
+	{
+		return Head;
+	}
+
+	int32 Num() const
+	{
+		return Count;
+	}
+
+	void Empty()
+	{
+		Links.Empty();
+		Head = Tail = FreeHead = INDEX_NONE;
+		Count = 0;
+	}
+
+	/** Bytes held by the links, not counting heap memory owned by the keys */
+	SIZE_T GetAllocatedSize() const
+	{
+		return Links.GetAllocatedSize();
+	}
+
+private:
+	struct FLink
+	{
+		FLink() : Prev(INDEX_NONE), Next(INDEX_NONE) {}
+
+		KeyType Key;
+		int32 Prev;
+		int32 Next;
+	};
+
+	TArray<FLink> Links;
+	int32 Head;
+	int32 Tail;
+
+	// unused links, chained through Next
+	int32 FreeHead;
+	int32 Count;
+
+	void Unlink(int32 Handle)
+	{
+		FLink& Link = Links[Handle];
+		if (Link.Prev != INDEX_NONE)
+		{
+			Links[Link.Prev].Next = Link.Next;
+		}
+		else
+		{
+			Head = Link.Next;
+		}
+		if (Link.Next != INDEX_NONE)
+		{
+			Links[Link.Next].Prev = Link.Prev;
+		}
+		else
+		{
+			Tail = Link.Prev;
+		}
+		Link.Prev = Link.Next = INDEX_NONE;
+	}
+
+	void LinkAtTail(int32 Handle)
+	{
+		FLink& Link = Links[Handle];
+		Link.Prev = Tail;
+		Link.Next = INDEX_NONE;
+		if (Tail != INDEX_NONE)
+		{
+			Links[Tail].Next = Handle;
+		}
+		else
+		{
+			Head = Handle;
+		}
+		Tail = Handle;
+	}
+};
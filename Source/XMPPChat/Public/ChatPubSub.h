@@ -0,0 +1,252 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#pragma once
+
+#include "Xmpp.h"
+#include "ChatLru.h"
+
+/** Received PubSub items are shared between the cache and every listener, never copied per listener */
+typedef TSharedRef<const FXmppPubSubMessage> FChatPubSubItemRef;
+
+/** Native listener for items received on a PubSub node */
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnChatPubSubItem, const FXmppPubSubId& /*NodeId*/, const FChatPubSubItemRef& /*Item*/);
+
+/**
+* Maps PubSub node ids to native listeners for O(1) fan-out of received items,
+* and remembers the last few items per node so late listeners get current state
+* without a server round trip
+*/
+class FChatPubSubRegistry
+{
+public:
+	FChatPubSubRegistry() : CachedBytes(0), NextStamp(0), NumCachedItems(0), AgeHead(0) {}
+
+	/** Register a listener for a node, optionally replaying the cached items to it (oldest first) */
+	FDelegateHandle AddListener(const FXmppPubSubId& NodeId, const FOnChatPubSubItem::FDelegate& Listener, bool bReplayCached);
+
+	void RemoveListener(const FXmppPubSubId& NodeId, FDelegateHandle Handle);
+
+	/**
+	* Cache the item and fan it out to the node's listeners.
+	* At most CacheSize items are kept per node, and past MaxCacheBytes over all nodes the oldest items go first (0 for no limit)
+	*/
+	void Dispatch(const FXmppPubSubId& NodeId, const FChatPubSubItemRef& Item, int32 CacheSize, int32 MaxCacheBytes);
+
+	/** Cached items for a node, oldest first */
+	void GetCachedItems(const FXmppPubSubId& NodeId, TArray<FChatPubSubItemRef>& OutItems) const;
+
+	/** Forget cached items for a node, listeners stay registered. Nodes without listeners or cached items are dropped */
+	void ClearCache(const FXmppPubSubId& NodeId);
+
+	/** Forget a node entirely, including its listeners */
+	void RemoveNode(const FXmppPubSubId& NodeId);
+
+	/** Bytes held by cached items and node bookkeeping */
+	SIZE_T GetAllocatedSize() const;
+
+	/** Estimated heap bytes of a PubSub item */
+	static SIZE_T GetItemSize(const FXmppPubSubMessage& Item);
+
+private:
+	struct FCachedItem
+	{
+		FCachedItem(const FChatPubSubItemRef& InItem, uint64 InStamp, SIZE_T InBytes) : Item(InItem), Stamp(InStamp), Bytes(InBytes) {}
+
+		FChatPubSubItemRef Item;
+
+		// order of arrival over all nodes, to find the oldest item when over the byte limit
+		uint64 Stamp;
+		SIZE_T Bytes;
+	};
+
+	struct FNode
+	{
+		FNode() : Head(0) {}
+
+		FXmppPubSubId NodeId;
+		FOnChatPubSubItem Listeners;
+
+		// ring buffer of the last items; once full, Head is the index of the oldest item
+		TArray<FCachedItem> Items;
+		int32 Head;
+
+		// rotate the ring so the oldest item is at index 0
+		void Linearize();
+	};
+
+	// nodes are shared so a listener registering on another node mid-broadcast can't move the one being broadcast
+	TMap<FXmppPubSubId, TSharedRef<FNode>> Nodes;
+
+	// bytes of all cached items
+	SIZE_T CachedBytes;
+	uint64 NextStamp;
+	int32 NumCachedItems;
+
+	// a cached item, found through its node and stamp
+	struct FAgeEntry
+	{
+		FAgeEntry(const TSharedRef<FNode>& InNode, uint64 InStamp) : Node(InNode), Stamp(InStamp) {}
+
+		TWeakPtr<FNode> Node;
+		uint64 Stamp;
+	};
+
+	// every item cached in order of arrival, from AgeHead on. Items that left their node stay
+	// until they reach the front or the queue is compacted, so evicting the oldest is O(1) amortized
+	TArray<FAgeEntry> AgeQueue;
+	int32 AgeHead;
+
+	TSharedRef<FNode> FindOrAddNode(const FXmppPubSubId& NodeId);
+
+	// drop the oldest cached items of a node
+	void RemoveOldest(FNode& Node, int32 Count);
+
+	// drop the oldest cached item over all nodes
+	void EvictOldest();
+
+	void PushAge(const TSharedRef<FNode>& Node, uint64 Stamp);
+	static bool IsCached(const FAgeEntry& Entry);
+
+	// drop the node if it has no listeners and nothing cached
+	void PruneNode(const FXmppPubSubId& NodeId);
+};
+
+/** Running totals for PubSub traffic through the plugin */
+struct FChatPubSubCounters
+{
+	FChatPubSubCounters()
+		: PublishRequests(0), PublishesSent(0), PublishesCoalesced(0), KeyframesSent(0), DeltasSent(0)
+		, BytesRequested(0), BytesSent(0), ItemsReceived(0), DeltasApplied(0), DeltasDropped(0), BytesReceived(0)
+	{}
+
+	// calls to publish, and how many of them actually went out
+	uint64 PublishRequests;
+	uint64 PublishesSent;
+	// publishes replaced by a newer value inside the batch window
+	uint64 PublishesCoalesced;
+	uint64 KeyframesSent;
+	uint64 DeltasSent;
+	// UTF-8 bytes that would have been sent without batching/deltas, and what was really sent
+	uint64 BytesRequested;
+	uint64 BytesSent;
+
+	uint64 ItemsReceived;
+	uint64 DeltasApplied;
+	// deltas that arrived without the item they were based on
+	uint64 DeltasDropped;
+	uint64 BytesReceived;
+};
+
+/** How PubSub publishes are sent */
+struct FChatPubSubPublishSettings
+{
+	FChatPubSubPublishSettings() : BatchWindow(0.0f), bDeltaEncoding(false), KeyframeInterval(10), MaxNodes(0) {}
+
+	// seconds to hold publishes per node so only the latest value is sent, 0 sends immediately
+	float BatchWindow;
+	// send the difference against the previously published item instead of the full payload
+	bool bDeltaEncoding;
+	// with delta encoding, send the full payload every this many publishes
+	int32 KeyframeInterval;
+	// most nodes with batching and delta state, the least recently published to goes first past this (0 for no limit)
+	int32 MaxNodes;
+};
+
+/**
+* Batches publishes per node within a time window and optionally delta encodes
+* them against the previously published item, with periodic full keyframes
+*/
+class FChatPubSubPublisher
+{
+public:
+	FChatPubSubPublisher() : NumPending(0) {}
+
+	/** Send the payload now, or hold it until the batch window for the node runs out */
+	void Publish(IXmppPubSub& PubSub, const FXmppPubSubId& NodeId, const FString& Payload, const FChatPubSubPublishSettings& Settings, double Now, FChatPubSubCounters& Counters);
+
+	/** Send held payloads whose batch window has run out, or all of them if bForce */
+	void Flush(IXmppPubSub& PubSub, const FChatPubSubPublishSettings& Settings, double Now, bool bForce, FChatPubSubCounters& Counters);
+
+	/** Forget held payloads and delta state for a node */
+	void RemoveNode(const FXmppPubSubId& NodeId);
+
+	/** Bytes held by queued payloads and delta bases */
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	struct FNodeState
+	{
+		FNodeState() : bPending(false), PendingSince(0.0), bHasLastSent(false), Sequence(0), SinceKeyframe(0), LruHandle(INDEX_NONE) {}
+
+		FString PendingPayload;
+		bool bPending;
+		double PendingSince;
+
+		// last payload sent, the base for the next delta
+		FString LastSent;
+		bool bHasLastSent;
+		uint32 Sequence;
+		int32 SinceKeyframe;
+
+		// place in PublishOrder
+		int32 LruHandle;
+	};
+
+	TMap<FXmppPubSubId, FNodeState> Nodes;
+
+	// nodes by last publish, to evict the least recently published to in O(1)
+	TChatLruList<FXmppPubSubId> PublishOrder;
+
+	// number of nodes holding a payload, so Flush can skip the scan when idle
+	int32 NumPending;
+
+	void Send(IXmppPubSub& PubSub, const FXmppPubSubId& NodeId, FNodeState& State, const FString& Payload, const FChatPubSubPublishSettings& Settings, FChatPubSubCounters& Counters);
+
+	// forget the least recently published to node, sending its held payload first
+	void EvictOldest(IXmppPubSub& PubSub, const FChatPubSubPublishSettings& Settings, FChatPubSubCounters& Counters);
+};
+
+/**
+* Rebuilds full payloads from items published by FChatPubSubPublisher with delta encoding.
+* Items not produced by the publisher pass through untouched
+*/
+class FChatPubSubDecoder
+{
+public:
+	/**
+	* The item with its full payload, or null if it is a delta whose base item was never received.
+	* Past MaxStreams (node and publisher pairs, 0 for no limit) the least recently heard from is forgotten
+	*/
+	TSharedPtr<const FXmppPubSubMessage> Decode(const FXmppPubSubId& NodeId, const TSharedRef<FXmppPubSubMessage>& Item, int32 MaxStreams, FChatPubSubCounters& Counters);
+
+	void RemoveNode(const FXmppPubSubId& NodeId);
+
+	/** Bytes held by rebuilt payloads */
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	struct FPublisherState
+	{
+		FPublisherState() : bValid(false), Sequence(0), LruHandle(INDEX_NONE) {}
+
+		// last full payload as UTF-8, the unit deltas are cut in
+		TArray<ANSICHAR> Payload;
+		bool bValid;
+		uint32 Sequence;
+
+		// place in ActiveOrder
+		int32 LruHandle;
+	};
+
+	// per node, per publishing jid
+	TMap<FXmppPubSubId, TMap<FString, FPublisherState>> Nodes;
+
+	// node and publisher
+	typedef TPair<FXmppPubSubId, FString> FStreamKey;
+
+	// publisher states over all nodes by last item, to evict the least recently heard from in O(1)
+	TChatLruList<FStreamKey> ActiveOrder;
+
+	// forget the least recently heard from publisher state
+	void EvictOldest();
+};
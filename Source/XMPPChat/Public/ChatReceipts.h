@@ -0,0 +1,78 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#pragma once
+
+#include "Engine.h"
+
+/**
+* Log scale histogram of message round trip times.
+* Buckets are plain atomic counters, so samples can be added and percentiles read from any thread without locks
+*/
+class FChatLatencyHistogram
+{
+public:
+	// 8 buckets per doubling from 1ms, the last bucket also holds everything above ~65s
+	static const int32 BucketsPerOctave = 8;
+	static const int32 NumBuckets = 128;
+
+	void Add(double Seconds);
+
+	/** Round trip in milliseconds that Fraction (0-1) of the samples are at or below, 0 without samples */
+	float GetPercentileMs(float Fraction) const;
+
+	int32 GetNumSamples() const;
+
+	void Reset();
+
+private:
+	FThreadSafeCounter Buckets[NumBuckets];
+	FThreadSafeCounter NumSamples;
+
+	static int32 GetBucket(double Milliseconds);
+	static float GetBucketUpperMs(int32 Bucket);
+};
+
+/**
+* Messages sent with a receipt request, waiting for their ack.
+* Bounded by a timeout and a cap on the number pending, oldest dropped first
+*/
+class FChatReceiptTracker
+{
+public:
+	FChatReceiptTracker();
+
+	/** Id to send with a message going out now */
+	FString Track(double Now, int32 MaxPending);
+
+	/** Was the id handed out by Track in this session? */
+	bool IsOwnId(const FString& ReceiptId) const;
+
+	/** Match an ack (or our own MUC echo) to a pending receipt and record the round trip. False if it isn't ours or already gone */
+	bool Complete(const FString& ReceiptId, double Now, FChatLatencyHistogram& Histogram);
+
+	/** Drop receipts pending for longer than Timeout seconds */
+	void Expire(double Now, float Timeout);
+
+	int32 GetNumPending() const { return Pending.Num(); }
+	uint64 GetNumTimedOut() const { return NumTimedOut; }
+	uint64 GetNumEvicted() const { return NumEvicted; }
+
+	/** Bytes held by pending receipts */
+	SIZE_T GetAllocatedSize() const { return SessionId.GetAllocatedSize() + Pending.GetAllocatedSize(); }
+
+	/** Random per session prefix of our ids, so ids from other clients never match */
+	const FString& GetSessionId() const { return SessionId; }
+
+private:
+	FString SessionId;
+
+	// ids are handed out in order, so the oldest pending receipt is the lowest id still in Pending
+	uint32 NextId;
+	uint32 OldestId;
+	TMap<uint32, double> Pending;
+
+	uint64 NumTimedOut;
+	uint64 NumEvicted;
+
+	void PopOldest();
+};
@@ -0,0 +1,68 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#pragma once
+
+#include "Xmpp.h"
+#include "ChatLru.h"
+
+/**
+* Room info fetched from the server, kept for a TTL so repeated refreshes of the
+* same room are answered locally, and concurrent refreshes share one request
+*/
+class FChatRoomInfoCache
+{
+public:
+	/**
+	* Should a refresh request go out for the room?
+	* False while the cached info is younger than TTL or a request is already in flight.
+	* When true the room is marked in flight until CompleteRefresh or RequestTimeout
+	*/
+	bool BeginRefresh(const FXmppRoomId& RoomId, double Now, float TTL, float RequestTimeout, bool bForce, int32 MaxEntries);
+
+	/**
+	* Store the result of a refresh, Info is only read on success.
+	* If the room was invalidated after the request went out the info is kept but stays stale
+	*/
+	void CompleteRefresh(const FXmppRoomId& RoomId, bool bSuccess, const FXmppRoomInfo& Info, double Now, int32 MaxEntries);
+
+	/** Keep the cached info for display, but make the next refresh after any in flight one go to the server */
+	void Invalidate(const FXmppRoomId& RoomId);
+
+	/** Invalidate every room after a connection change, also dropping requests in flight since their answers are lost */
+	void InvalidateAll();
+
+	/** Cached info for the room, or null if it was never fetched */
+	const FXmppRoomInfo* Find(const FXmppRoomId& RoomId, double Now, float TTL, bool& bOutIsStale, float& OutAge) const;
+
+	/** Bytes held by cached entries */
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	struct FEntry
+	{
+		FEntry() : bHasInfo(false), bInvalidated(false), FetchedTime(0.0), Generation(0), bInFlight(false), RequestTime(0.0), RequestGeneration(0), LruHandle(INDEX_NONE) {}
+
+		FXmppRoomInfo Info;
+		bool bHasInfo;
+		bool bInvalidated;
+		double FetchedTime;
+
+		// bumped on every invalidation, so an answer to a request sent before it is not taken as fresh
+		uint32 Generation;
+
+		bool bInFlight;
+		double RequestTime;
+		uint32 RequestGeneration;
+
+		// place in UseOrder
+		int32 LruHandle;
+	};
+
+	TMap<FXmppRoomId, FEntry> Entries;
+
+	// rooms by last request or answer, to drop the least recently used in O(1)
+	TChatLruList<FXmppRoomId> UseOrder;
+
+	// the entry for RoomId, making room by dropping the least recently used one past MaxEntries (0 for no limit)
+	FEntry& FindOrAddEntry(const FXmppRoomId& RoomId, int32 MaxEntries);
+};
@@ -0,0 +1,127 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#pragma once
+
+#include "Engine.h"
+#include "ChatLru.h"
+
+/** A received chat message on its way to BP */
+struct FChatSequencedMessage
+{
+	FChatSequencedMessage() : bIsRoom(false) {}
+
+	/** MUC message, otherwise private chat */
+	bool bIsRoom;
+
+	/** room id, or the peer's user id for private chat */
+	FString Channel;
+
+	/** nickname in the room, or the peer's full jid for private chat */
+	FString Sender;
+
+	FString Body;
+};
+
+/**
+* Per destination sequence numbers for outgoing messages, and per sender dedupe and
+* reordering of incoming ones so each message is delivered once and in order.
+* Duplicates are found with a sliding window bitmap, out of order messages wait in a
+* small bounded buffer until the gap fills or times out, all at constant cost per message
+*/
+class FChatSequencer
+{
+public:
+	// messages further ahead than this restart the stream instead of being buffered
+	static const uint32 WindowSize = 64;
+
+	FChatSequencer();
+
+	/** Random per session id; receivers restart a stream when it changes */
+	const FString& GetSessionId() const { return SessionId; }
+
+	/** Sequence number for the next message to Destination */
+	uint32 NextOutgoing(const FString& Destination);
+
+	/**
+	* Take a message from the stream StreamKey (one per sending resource and room/peer) and append whatever is now in order to OutReady.
+	* A new Session on an existing stream means the sender restarted, and the stream starts over.
+	* A stream first heard from mid-way is held like a gap, so messages that overtook earlier ones aren't lost.
+	* At most MaxBuffered messages wait for a gap to fill; past that the gap is given up on.
+	* Past MaxBufferedBytes over all streams the oldest gap is given up on first.
+	* Past MaxStreams the least recently active stream is forgotten (0 for no limit on either)
+	*/
+	void Receive(const FString& StreamKey, const FString& Session, uint32 Sequence, FChatSequencedMessage&& Message, double Now, int32 MaxBuffered, int32 MaxBufferedBytes, int32 MaxStreams, TArray<FChatSequencedMessage>& OutReady);
+
+	/** Give up on gaps open for longer than Timeout seconds, appending the messages waiting behind them to OutReady */
+	void Expire(double Now, float Timeout, TArray<FChatSequencedMessage>& OutReady);
+
+	/** Bytes held by stream state, buffered messages and outgoing counters */
+	SIZE_T GetAllocatedSize() const;
+
+	uint64 GetNumDuplicates() const { return NumDuplicates; }
+	uint64 GetNumReordered() const { return NumReordered; }
+	uint64 GetNumSkipped() const { return NumSkipped; }
+
+private:
+	struct FBuffered
+	{
+		uint32 Sequence;
+		FChatSequencedMessage Message;
+		SIZE_T Bytes;
+	};
+
+	struct FStream
+	{
+		FStream() : NextExpected(0), bOpenStart(false), BufferedBits(0), GapSince(0.0), GapHandle(INDEX_NONE), ActiveHandle(INDEX_NONE) {}
+
+		FString Session;
+		uint32 NextExpected;
+
+		// a new stream that didn't start at 1 holds its messages for one gap timeout, and
+		// earlier ones within the window arriving meanwhile move NextExpected back
+		bool bOpenStart;
+
+		// bit i set when NextExpected + i is waiting in Buffered
+		uint64 BufferedBits;
+
+		// sorted by sequence, bounded by MaxBuffered
+		TArray<FBuffered> Buffered;
+		double GapSince;
+
+		// place in GapOrder while anything is buffered, and in ActiveOrder
+		int32 GapHandle;
+		int32 ActiveHandle;
+	};
+
+	FString SessionId;
+
+	// outgoing counters are never dropped, a count restarted in the same session would read as duplicates on the other end
+	TMap<FString, uint32> Outgoing;
+	TMap<FString, FStream> Streams;
+
+	// streams by last activity, to evict the least recently active in O(1)
+	TChatLruList<FString> ActiveOrder;
+
+	// streams with messages waiting on a gap, oldest gap first; the only ones Expire needs to look at
+	TChatLruList<FString> GapOrder;
+
+	// bytes of all buffered messages
+	SIZE_T BufferedBytes;
+
+	uint64 NumDuplicates;
+	uint64 NumReordered;
+	uint64 NumSkipped;
+
+	void Advance(FStream& Stream, uint32 Count);
+	void Drain(FStream& Stream, TArray<FChatSequencedMessage>& OutReady);
+	void SkipTo(FStream& Stream, uint32 Sequence, TArray<FChatSequencedMessage>& OutReady);
+	void FlushAll(FStream& Stream, TArray<FChatSequencedMessage>& OutReady);
+
+	// forget the least recently active stream, delivering what it was holding
+	void EvictOldest(TArray<FChatSequencedMessage>& OutReady);
+
+	// give up on the gap that has been open longest over all streams
+	void SkipOldestGap(TArray<FChatSequencedMessage>& OutReady);
+
+	static SIZE_T GetMessageSize(const FChatSequencedMessage& Message);
+};
@@ -0,0 +1,89 @@
+// (c) 2015 Descendent Studios, Inc.
+
+#pragma once
+
+#include "Engine.h"
+#include "ChatLru.h"
+
+/**
+* Finds @mentions of the local user in a message body.
+* Names are compiled once into a case insensitive set and the distinct name lengths,
+* so a body is scanned in a single pass with one set lookup per '@' and length
+*/
+class FChatMentionMatcher
+{
+public:
+	void SetNames(const TArray<FString>& InNames);
+
+	/** Does Body mention one of the names, or ExtraName (e.g. our nickname in the room) if not empty? */
+	bool Matches(const FString& Body, const FString& ExtraName) const;
+
+private:
+	// FString hashing and equality are case insensitive
+	TSet<FString> Names;
+
+	// distinct lengths of Names, longest first
+	TArray<int32> Lengths;
+
+	static bool IsNameChar(TCHAR Char);
+};
+
+/**
+* Unread and mention counts per channel (room or peer), updated in O(1) per message.
+* Messages are numbered per channel as they arrive, so a channel can be marked read up to a given message
+*/
+class FChatUnreadTracker
+{
+public:
+	/**
+	* Count a message on the channel, keeping at most MaxMentions unread mention positions. Returns the message's index.
+	* Past MaxChannels (0 for no limit) the least recently active channel is forgotten
+	*/
+	int32 Add(const FString& Channel, bool bMention, int32 MaxMentions, int32 MaxChannels);
+
+	/** Mark messages up to and including UpToIndex read, or all of them if UpToIndex is negative */
+	void MarkRead(const FString& Channel, int32 UpToIndex);
+
+	/** False if nothing was ever counted on the channel */
+	bool Get(const FString& Channel, int32& OutUnread, int32& OutMentions, int32& OutLastIndex) const;
+
+	void Remove(const FString& Channel);
+
+	/** Channels whose counts changed since the last call */
+	void ConsumeChanged(TArray<FString>& OutChannels);
+
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	struct FChannel
+	{
+		FChannel() : LastIndex(0), ReadIndex(0), MentionHead(0), bChanged(false), LruHandle(INDEX_NONE) {}
+
+		int32 LastIndex;
+		int32 ReadIndex;
+
+		// indices of mentions, unread ones start at MentionHead
+		TArray<int32> Mentions;
+		int32 MentionHead;
+
+		bool bChanged;
+
+		// place in ActiveOrder
+		int32 LruHandle;
+	};
+
+	TMap<FString, FChannel> Channels;
+	TArray<FString> Changed;
+
+	// channels removed since the last ConsumeChanged, already in Changed if they come back
+	TSet<FString> RemovedChanged;
+
+	// channels by when a message was last counted or read, to forget the least recently active in O(1)
+	TChatLruList<FString> ActiveOrder;
+
+	void SetChanged(const FString& Channel, FChannel& State);
+	static void DropMentions(FChannel& State, int32 Count);
+
+	// forget the least recently active channel
+	void EvictOldest();
+};